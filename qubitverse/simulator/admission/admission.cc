@@ -0,0 +1,118 @@
+/**
+ * @file admission.cc
+ * @license This file is licensed under the GNU GENERAL PUBLIC LICENSE Version 3, 29 June 2007. You may obtain a copy of this license at https://www.gnu.org/licenses/gpl-3.0.en.html.
+ * @author Tushar Chaurasia (Dark-CodeX)
+ */
+
+#include "./admission.hh"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace simulator
+{
+    static double now_ms()
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    const double &admission_controller::ticket::wait_ms() const
+    {
+        return this->M_wait_ms;
+    }
+
+    admission_controller::ticket::~ticket()
+    {
+        if (!this->M_owner)
+            return;
+        admission_controller &c = *this->M_owner;
+        {
+            std::lock_guard<std::mutex> guard(c.M_lock);
+            c.M_in_use -= this->M_bytes;
+            c.M_running--;
+            const double held = now_ms() - this->M_start_ms;
+            c.M_mean_hold_ms = c.M_mean_hold_ms == 0 ? held : 0.8 * c.M_mean_hold_ms + 0.2 * held;
+        }
+        c.M_cv.notify_all();
+    }
+
+    admission_controller::admission_controller(const std::size_t &budget, const std::size_t &max_queue, const std::size_t &timeout_ms)
+        : M_budget(budget), M_max_queue(max_queue), M_timeout_ms(timeout_ms) {}
+
+    void admission_controller::set_reclaim(std::function<std::size_t()> idle, std::function<void()> reclaim)
+    {
+        std::lock_guard<std::mutex> guard(this->M_lock);
+        this->M_idle = std::move(idle);
+        this->M_reclaim = std::move(reclaim);
+    }
+
+    // called with M_lock held
+    bool admission_controller::fits(const std::size_t &bytes)
+    {
+        if (this->M_in_use + bytes > this->M_budget)
+            return false;
+        if (this->M_idle && this->M_idle() > this->M_budget - this->M_in_use - bytes)
+            this->M_reclaim();
+        return true;
+    }
+
+    admission_status admission_controller::acquire(const std::size_t &bytes, ticket &t)
+    {
+        const double start = now_ms();
+        std::unique_lock<std::mutex> lk(this->M_lock);
+
+        // the queue is FIFO: a request that would fit is still queued behind the ones that were already waiting
+        if (!this->M_queue.empty() || !this->fits(bytes))
+        {
+            if (this->M_queue.size() >= this->M_max_queue)
+            {
+                this->M_rejected++;
+                return admission_status::QUEUE_FULL;
+            }
+            const std::uint64_t id = this->M_next_ticket++;
+            this->M_queue.push_back(id);
+            const bool admitted = this->M_cv.wait_for(lk, std::chrono::milliseconds(this->M_timeout_ms), [&]
+                                                      { return this->M_queue.front() == id && this->fits(bytes); });
+            this->M_queue.erase(std::find(this->M_queue.begin(), this->M_queue.end(), id));
+            if (!admitted)
+            {
+                this->M_timed_out++;
+                lk.unlock();
+                // the next request in line may fit now that this one left the queue
+                this->M_cv.notify_all();
+                return admission_status::TIMED_OUT;
+            }
+        }
+
+        this->M_in_use += bytes;
+        this->M_running++;
+        this->M_admitted++;
+        t.M_owner = this;
+        t.M_bytes = bytes;
+        t.M_start_ms = now_ms();
+        t.M_wait_ms = t.M_start_ms - start;
+        this->M_total_wait_ms += t.M_wait_ms;
+        this->M_max_wait_ms = std::max(this->M_max_wait_ms, t.M_wait_ms);
+        lk.unlock();
+        // several small requests can fit side by side, let the new head of the queue check again
+        this->M_cv.notify_all();
+        return admission_status::ADMITTED;
+    }
+
+    std::size_t admission_controller::retry_after() const
+    {
+        std::lock_guard<std::mutex> guard(this->M_lock);
+        // everything queued has to run before a retry can be admitted, one request at a time in the worst case
+        const double ms = this->M_mean_hold_ms * static_cast<double>(this->M_queue.size() + 1);
+        return std::max<std::size_t>(1, static_cast<std::size_t>(std::ceil(ms / 1000.0)));
+    }
+
+    admission_stats admission_controller::stats() const
+    {
+        std::lock_guard<std::mutex> guard(this->M_lock);
+        return {this->M_budget, this->M_in_use,
+                this->M_running, this->M_queue.size(),
+                this->M_admitted, this->M_rejected, this->M_timed_out,
+                this->M_admitted ? this->M_total_wait_ms / static_cast<double>(this->M_admitted) : 0.0, this->M_max_wait_ms};
+    }
+}
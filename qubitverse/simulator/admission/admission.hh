@@ -0,0 +1,91 @@
+/**
+ * @file admission.hh
+ * @license This file is licensed under the GNU GENERAL PUBLIC LICENSE Version 3, 29 June 2007. You may obtain a copy of this license at https://www.gnu.org/licenses/gpl-3.0.en.html.
+ * @author Tushar Chaurasia (Dark-CodeX)
+ */
+
+#ifndef SIMULATOR_ADMISSION
+#define SIMULATOR_ADMISSION
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+namespace simulator
+{
+    enum admission_status : unsigned char
+    {
+        ADMITTED,
+        QUEUE_FULL, // too many requests are already waiting, answered with 429
+        TIMED_OUT   // waited longer than the queue timeout, answered with 503
+    };
+
+    struct admission_stats
+    {
+        std::size_t M_budget, M_in_use;      // bytes
+        std::size_t M_running, M_queued;     // requests holding memory, requests waiting for it
+        std::size_t M_admitted, M_rejected, M_timed_out;
+        double M_mean_wait_ms, M_max_wait_ms; // over the admitted requests
+    };
+
+    // keeps the memory of the requests running at the same time under `budget` bytes
+    // a request that does not fit waits in a FIFO queue (at most `max_queue` of them, for at most `timeout_ms`), so a large request is not starved by smaller ones behind it
+    class admission_controller
+    {
+      private:
+        std::size_t M_budget, M_max_queue, M_timeout_ms;
+        std::size_t M_in_use = 0, M_running = 0;
+        std::size_t M_admitted = 0, M_rejected = 0, M_timed_out = 0;
+        double M_total_wait_ms = 0, M_max_wait_ms = 0;
+        double M_mean_hold_ms = 0; // exponential moving average of how long admitted requests keep their memory
+        std::uint64_t M_next_ticket = 0;
+        std::deque<std::uint64_t> M_queue;
+        mutable std::mutex M_lock;
+        std::condition_variable M_cv;
+        std::function<std::size_t()> M_idle; // memory held outside the tickets, see set_reclaim()
+        std::function<void()> M_reclaim;
+
+        bool fits(const std::size_t &bytes);
+
+      public:
+        // releases the memory of an admitted request when it goes out of scope
+        class ticket
+        {
+          private:
+            admission_controller *M_owner = nullptr;
+            std::size_t M_bytes = 0;
+            double M_wait_ms = 0;
+            double M_start_ms = 0;
+
+            friend class admission_controller;
+
+          public:
+            ticket() = default;
+            ticket(const ticket &) = delete;
+            ticket &operator=(const ticket &) = delete;
+            const double &wait_ms() const;
+            ~ticket();
+        };
+
+        admission_controller() = delete;
+        admission_controller(const std::size_t &budget, const std::size_t &max_queue, const std::size_t &timeout_ms);
+        admission_controller(const admission_controller &) = delete;
+        admission_controller &operator=(const admission_controller &) = delete;
+
+        // `idle` reports memory that no ticket accounts for but that `reclaim` can free (the idle buffers of a pooled_allocator, say)
+        // a request that fits the budget but not together with that memory frees it first, so the budget bounds both
+        void set_reclaim(std::function<std::size_t()> idle, std::function<void()> reclaim);
+        // blocks until `bytes` fit in the budget, `t` holds them on ADMITTED
+        // `bytes` larger than the whole budget must be refused by the caller beforehand
+        [[nodiscard]] admission_status acquire(const std::size_t &bytes, ticket &t);
+        // seconds after which a rejected client should try again, estimated from the queue depth and the recent request durations
+        std::size_t retry_after() const;
+        admission_stats stats() const;
+        ~admission_controller() = default;
+    };
+}
+
+#endif
@@ -0,0 +1,129 @@
+/**
+ * @file layout_bench.cc
+ * @license This file is licensed under the GNU GENERAL PUBLIC LICENSE Version 3, 29 June 2007. You may obtain a copy of this license at https://www.gnu.org/licenses/gpl-3.0.en.html.
+ * @author Tushar Chaurasia (Dark-CodeX)
+ */
+
+// time of every gate type on the interleaved (AOS) and split (SOA) state-vector layouts
+// usage: layout_bench [QUBITS (default 22)] [REPEATS (default 10)] [THREADS (default all)]
+
+#include "../gates/gates.hh"
+#include "../gates/kernels.hh"
+#include "../gates/thread_pool.hh"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct bench_case
+{
+    std::string M_name;
+    std::function<void(simulator::qubit &)> M_fn;
+};
+
+// best of `repeats` runs, in ms, after one run to fault the pages and warm the caches
+static double time_ms(simulator::qubit &q, const bench_case &c, const std::size_t &repeats)
+{
+    c.M_fn(q);
+    double best = 1e300;
+    for (std::size_t r = 0; r < repeats; r++)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        c.M_fn(q);
+        best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    const std::size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 22;
+    const std::size_t repeats = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 10;
+    if (argc > 3)
+        simulator::thread_pool::instance().set_threads(std::strtoul(argv[3], nullptr, 10));
+    if (n < 8)
+    {
+        std::fprintf(stderr, "error: at-least 8 qubits are needed to place every gate\n");
+        return EXIT_FAILURE;
+    }
+
+    const std::size_t lo = 1, mid = n / 2, hi = n - 2; // a target inside a vector register, one in the middle and one with the largest stride
+    // H on every target, dense and unitary so that the norm stays put however often it is applied
+    const auto hadamards = [](const std::size_t &k)
+    {
+        const std::size_t dim = std::size_t(1) << k;
+        std::vector<simulator::qubit::complex> m(dim * dim);
+        for (std::size_t r = 0; r < dim; r++)
+            for (std::size_t c = 0; c < dim; c++)
+                m[r * dim + c] = (__builtin_popcountll(r & c) & 1 ? -1.0 : 1.0) / std::sqrt(static_cast<double>(dim));
+        return m;
+    };
+    const std::vector<simulator::qubit::complex> m2 = hadamards(2), m4 = hadamards(4);
+    simulator::qubit::complex ry[2][2];
+    simulator::qubit::get_gate_matrix(ry, "Ry", 0.4);
+    std::vector<double> probs(std::size_t(1) << n);
+    double *probs_ptr = probs.data();
+
+    const std::vector<bench_case> cases = {
+        {"H q" + std::to_string(lo), [&](simulator::qubit &q)
+         { q.apply_hadamard(lo); }},
+        {"H q" + std::to_string(mid), [&](simulator::qubit &q)
+         { q.apply_hadamard(mid); }},
+        {"H q" + std::to_string(hi), [&](simulator::qubit &q)
+         { q.apply_hadamard(hi); }},
+        {"X", [&](simulator::qubit &q)
+         { q.apply_pauli_x(mid); }},
+        {"Y", [&](simulator::qubit &q)
+         { q.apply_pauli_y(mid); }},
+        {"Z", [&](simulator::qubit &q)
+         { q.apply_pauli_z(mid); }},
+        {"S", [&](simulator::qubit &q)
+         { q.apply_phase_pi_2_shift(mid); }},
+        {"T", [&](simulator::qubit &q)
+         { q.apply_phase_pi_4_shift(mid); }},
+        {"P", [&](simulator::qubit &q)
+         { q.apply_phase_general_shift(0.3, mid); }},
+        {"Rx", [&](simulator::qubit &q)
+         { q.apply_rotation_x(0.3, mid); }},
+        {"Ry", [&](simulator::qubit &q)
+         { q.apply_rotation_y(0.3, mid); }},
+        {"Rz", [&](simulator::qubit &q)
+         { q.apply_rotation_z(0.3, mid); }},
+        {"CNOT", [&](simulator::qubit &q)
+         { q.apply_cnot(lo, hi); }},
+        {"CZ", [&](simulator::qubit &q)
+         { q.apply_cz(lo, hi); }},
+        {"SWAP", [&](simulator::qubit &q)
+         { q.apply_swap(lo, hi); }},
+        {"Toffoli", [&](simulator::qubit &q)
+         { q.apply_mcx({lo, mid}, hi); }},
+        {"ccRy", [&](simulator::qubit &q)
+         { q.apply_mcu({lo, hi}, ry, mid); }},
+        {"matrix 2q", [&](simulator::qubit &q)
+         { q.apply_matrix({lo, mid}, m2); }},
+        {"matrix 4q", [&](simulator::qubit &q)
+         { q.apply_matrix({0, lo + 2, mid, hi}, m4); }},
+        {"probabilities", [&](simulator::qubit &q)
+         { q.compute_probabilities(probs_ptr); }},
+        {"get_qubits", [&](simulator::qubit &q)
+         { (void)q.get_qubits(); }},
+    };
+
+    simulator::qubit aos(n, simulator::state_layout::AOS), soa(n, simulator::state_layout::SOA);
+    for (std::size_t t = 0; t < n; t++)
+    {
+        aos.apply_hadamard(t);
+        soa.apply_hadamard(t);
+    }
+
+    std::printf("%zu qubits, %zu thread(s), %s kernels, best of %zu\n", n, simulator::thread_pool::instance().get_threads(), simulator::kernels::active_isa(), repeats);
+    std::printf("%-16s %12s %12s %10s\n", "gate", "AOS ms", "SOA ms", "AOS/SOA");
+    for (const bench_case &c : cases)
+    {
+        const double a = time_ms(aos, c, repeats), s = time_ms(soa, c, repeats);
+        std::printf("%-16s %12.3f %12.3f %9.2fx\n", c.M_name.c_str(), a, s, a / s);
+    }
+    return EXIT_SUCCESS;
+}
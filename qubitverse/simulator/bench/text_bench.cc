@@ -0,0 +1,87 @@
+/**
+ * @file text_bench.cc
+ * @license This file is licensed under the GNU GENERAL PUBLIC LICENSE Version 3, 29 June 2007. You may obtain a copy of this license at https://www.gnu.org/licenses/gpl-3.0.en.html.
+ * @author Tushar Chaurasia (Dark-CodeX)
+ */
+
+// bytes per second of a text state snapshot, written through std::stringstream as before text_writer and through text_writer
+// usage: text_bench [QUBITS (default 20)] [REPEATS (default 10)]
+
+#include "../format/format.hh"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <sstream>
+#include <string>
+
+// the formatting set_quantum_states() used before text_writer
+static void stream_state(std::string &out, const std::string &label, const simulator::qubit &q)
+{
+    const simulator::qubit::complex *vec_space = q.get_qubits();
+    std::stringstream ss;
+    ss << label << "\n";
+    for (std::size_t i = 0; i < q.get_size(); i++)
+        ss << i << "=" << vec_space[i] << "\n";
+    out.append(ss.str());
+}
+
+// best of `repeats` runs in seconds, `bytes` receives the size of one snapshot
+static double time_s(const std::function<void(std::string &)> &fn, const std::size_t &repeats, std::size_t &bytes)
+{
+    std::string out;
+    fn(out);
+    bytes = out.size();
+    double best = 1e300;
+    for (std::size_t r = 0; r < repeats; r++)
+    {
+        out.clear();
+        const auto start = std::chrono::steady_clock::now();
+        fn(out);
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    const std::size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 20;
+    const std::size_t repeats = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 10;
+
+    // rotations leave every amplitude with a full mantissa, the worst case for the formatting
+    simulator::qubit q(n);
+    for (std::size_t t = 0; t < n; t++)
+    {
+        q.apply_rotation_y(0.3 + 0.1 * static_cast<double>(t), t);
+        q.apply_rotation_z(0.7 - 0.05 * static_cast<double>(t), t);
+    }
+    (void)q.get_qubits();
+
+    const simulator::text_writer digits6(6), shortest(simulator::text_writer::shortest);
+    struct
+    {
+        const char *M_name;
+        std::function<void(std::string &)> M_fn;
+    } cases[] = {
+        {"stringstream", [&](std::string &out)
+         { stream_state(out, "H", q); }},
+        {"text_writer 6", [&](std::string &out)
+         { digits6.state(out, "H", q); }},
+        {"text_writer shortest", [&](std::string &out)
+         { shortest.state(out, "H", q); }},
+    };
+
+    std::printf("%zu qubits, best of %zu\n", n, repeats);
+    std::printf("%-22s %12s %10s %10s\n", "formatter", "bytes", "ms", "MB/s");
+    double base = 0.0;
+    for (const auto &c : cases)
+    {
+        std::size_t bytes = 0;
+        const double s = time_s(c.M_fn, repeats, bytes);
+        const double rate = static_cast<double>(bytes) / s / 1e6;
+        if (base == 0.0)
+            base = rate;
+        std::printf("%-22s %12zu %10.3f %10.1f  (%.2fx)\n", c.M_name, bytes, s * 1e3, rate, rate / base);
+    }
+    return EXIT_SUCCESS;
+}
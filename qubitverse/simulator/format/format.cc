@@ -0,0 +1,354 @@
+/**
+ * @file format.cc
+ * @license This file is licensed under the GNU GENERAL PUBLIC LICENSE Version 3, 29 June 2007. You may obtain a copy of this license at https://www.gnu.org/licenses/gpl-3.0.en.html.
+ * @author Tushar Chaurasia (Dark-CodeX)
+ */
+
+#include "./format.hh"
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstring>
+#include <functional>
+
+namespace simulator
+{
+    bool sparse_filter::enabled() const
+    {
+        return this->M_epsilon >= 0.0 || this->M_top != 0;
+    }
+
+    // keeps the entries whose weight(i) is above the threshold, and only the M_top largest of them with a min-heap of at most M_top entries
+    template <typename W>
+    static void select_by(const sparse_filter &f, const std::size_t &len, W &&weight, std::vector<std::size_t> &indices)
+    {
+        indices.clear();
+        if (f.M_top == 0)
+        {
+            for (std::size_t i = 0; i < len; i++)
+                if (weight(i) > f.M_epsilon)
+                    indices.push_back(i);
+            return;
+        }
+
+        using entry = std::pair<double, std::size_t>;
+        std::vector<entry> heap;
+        heap.reserve(std::min(f.M_top, len) + 1);
+        for (std::size_t i = 0; i < len; i++)
+        {
+            const double w = weight(i);
+            if (w <= f.M_epsilon)
+                continue;
+            if (heap.size() < f.M_top)
+            {
+                heap.emplace_back(w, i);
+                std::push_heap(heap.begin(), heap.end(), std::greater<entry>());
+            }
+            else if (w > heap.front().first)
+            {
+                std::pop_heap(heap.begin(), heap.end(), std::greater<entry>());
+                heap.back() = {w, i};
+                std::push_heap(heap.begin(), heap.end(), std::greater<entry>());
+            }
+        }
+        for (const entry &e : heap)
+            indices.push_back(e.second);
+        std::sort(indices.begin(), indices.end());
+    }
+
+    void sparse_filter::select(const double *weights, const std::size_t &len, std::vector<std::size_t> &indices) const
+    {
+        select_by(*this, len, [weights](const std::size_t &i)
+                  { return weights[i]; }, indices);
+    }
+
+    void sparse_filter::select(const qubit::complex *amps, const std::size_t &len, std::vector<std::size_t> &indices) const
+    {
+        select_by(*this, len, [amps](const std::size_t &i)
+                  { return std::norm(amps[i]); }, indices);
+    }
+
+    // appends `value` in little-endian byte order
+    template <typename T>
+    static void put(std::string &out, T value)
+    {
+        if constexpr (std::endian::native == std::endian::big && sizeof(T) > 1)
+        {
+            using U = std::conditional_t<sizeof(T) == 8, std::uint64_t, std::conditional_t<sizeof(T) == 4, std::uint32_t, std::uint16_t>>;
+            value = std::bit_cast<T>(std::byteswap(std::bit_cast<U>(value)));
+        }
+        char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        out.append(bytes, sizeof(T));
+    }
+
+    static void pad(std::string &out)
+    {
+        out.append((8 - out.size() % 8) % 8, '\0');
+    }
+
+    static void frame(std::string &out, const binary_writer::frame_kind &kind, const std::size_t &real_size, const std::string &label, const std::size_t &count)
+    {
+        put<std::uint8_t>(out, kind);
+        put<std::uint8_t>(out, static_cast<std::uint8_t>(real_size));
+        put<std::uint16_t>(out, 0);
+        put<std::uint32_t>(out, static_cast<std::uint32_t>(label.size()));
+        put<std::uint64_t>(out, count);
+        out.append(label);
+        pad(out);
+    }
+
+    // converts `n` doubles to T and appends them, the buffer is grown once and written in place
+    template <typename T>
+    static void put_reals(std::string &out, const double *src, const std::size_t &n)
+    {
+        const std::size_t at = out.size();
+        out.resize(at + n * sizeof(T));
+        char *dst = out.data() + at;
+        for (std::size_t i = 0; i < n; i++)
+        {
+            T v = static_cast<T>(src[i]);
+            if constexpr (std::endian::native == std::endian::big)
+                v = std::bit_cast<T>(std::byteswap(std::bit_cast<std::conditional_t<sizeof(T) == 8, std::uint64_t, std::uint32_t>>(v)));
+            std::memcpy(dst + i * sizeof(T), &v, sizeof(T));
+        }
+        pad(out);
+    }
+
+    void binary_writer::header(std::string &out, const std::size_t &no_qubits)
+    {
+        out.append("QVB1", 4);
+        put<std::uint32_t>(out, static_cast<std::uint32_t>(no_qubits));
+    }
+
+    void binary_writer::state(std::string &out, const std::string &label, const qubit &q, const sparse_filter &sparse)
+    {
+        const bool fp32 = q.get_precision() == state_precision::FP32;
+        const std::size_t real_size = fp32 ? sizeof(float) : sizeof(double);
+        const qubit::complex *amps = q.get_qubits();
+        if (sparse.enabled())
+        {
+            std::vector<std::size_t> indices;
+            sparse.select(amps, q.get_size(), indices);
+            std::vector<double> reals(2 * indices.size());
+            for (std::size_t k = 0; k < indices.size(); k++)
+            {
+                reals[2 * k] = amps[indices[k]].real();
+                reals[2 * k + 1] = amps[indices[k]].imag();
+            }
+            frame(out, frame_kind::SPARSE_STATE, real_size, label, indices.size());
+            for (const std::size_t &i : indices)
+                put<std::uint64_t>(out, i);
+            if (fp32)
+                put_reals<float>(out, reals.data(), reals.size());
+            else
+                put_reals<double>(out, reals.data(), reals.size());
+            return;
+        }
+
+        frame(out, frame_kind::STATE, real_size, label, q.get_size());
+        // complex<double> is laid out as two doubles, re then im
+        const double *reals = reinterpret_cast<const double *>(amps);
+        if (fp32)
+            put_reals<float>(out, reals, 2 * q.get_size());
+        else
+            put_reals<double>(out, reals, 2 * q.get_size());
+    }
+
+    void binary_writer::probabilities(std::string &out, const double *probs, const std::size_t &len, const state_precision &precision, const sparse_filter &sparse)
+    {
+        const bool fp32 = precision == state_precision::FP32;
+        const std::size_t real_size = fp32 ? sizeof(float) : sizeof(double);
+        if (sparse.enabled())
+        {
+            std::vector<std::size_t> indices;
+            sparse.select(probs, len, indices);
+            std::vector<double> kept(indices.size());
+            for (std::size_t k = 0; k < indices.size(); k++)
+                kept[k] = probs[indices[k]];
+            frame(out, frame_kind::SPARSE_PROBABILITIES, real_size, "", indices.size());
+            for (const std::size_t &i : indices)
+                put<std::uint64_t>(out, i);
+            if (fp32)
+                put_reals<float>(out, kept.data(), kept.size());
+            else
+                put_reals<double>(out, kept.data(), kept.size());
+            return;
+        }
+
+        frame(out, frame_kind::PROBABILITIES, real_size, "", len);
+        if (fp32)
+            put_reals<float>(out, probs, len);
+        else
+            put_reals<double>(out, probs, len);
+    }
+
+    void binary_writer::counts(std::string &out, const qubit::histogram &hist)
+    {
+        frame(out, frame_kind::COUNTS, sizeof(std::uint64_t), "", hist.size());
+        for (const auto &[i, c] : hist)
+            put<std::uint64_t>(out, i);
+        for (const auto &[i, c] : hist)
+            put<std::uint64_t>(out, c);
+    }
+
+    void binary_writer::measurement(std::string &out, const std::size_t &outcome)
+    {
+        frame(out, frame_kind::MEASUREMENT, 0, "", 1);
+        put<std::uint64_t>(out, outcome);
+    }
+
+    // n * size, SIZE_MAX when it overflows
+    static std::size_t bytes_of(const std::size_t &n, const std::size_t &size)
+    {
+        return n > (SIZE_MAX - 32) / size ? SIZE_MAX : n * size;
+    }
+
+    static std::size_t frame_bytes(const std::size_t &entries, const std::size_t &entry_size)
+    {
+        const std::size_t bytes = bytes_of(entries, entry_size);
+        return bytes == SIZE_MAX ? SIZE_MAX : 16 + (bytes + 7) / 8 * 8;
+    }
+
+    std::size_t binary_writer::state_bytes(const std::size_t &len, const std::size_t &lines, const state_precision &precision, const sparse_filter &sparse)
+    {
+        const std::size_t real_size = precision == state_precision::FP32 ? sizeof(float) : sizeof(double);
+        return sparse.enabled() ? frame_bytes(lines, sizeof(std::uint64_t) + 2 * real_size) : frame_bytes(len, 2 * real_size);
+    }
+
+    std::size_t binary_writer::probabilities_bytes(const std::size_t &len, const std::size_t &lines, const state_precision &precision, const sparse_filter &sparse)
+    {
+        const std::size_t real_size = precision == state_precision::FP32 ? sizeof(float) : sizeof(double);
+        return sparse.enabled() ? frame_bytes(lines, sizeof(std::uint64_t) + real_size) : frame_bytes(len, real_size);
+    }
+
+    text_writer::text_writer(const int &digits)
+        : M_digits(digits) {}
+
+    char *text_writer::real(char *p, const double &v) const
+    {
+        if (this->M_digits == text_writer::shortest)
+            return std::to_chars(p, p + 24, v).ptr;
+        return std::to_chars(p, p + 24, v, std::chars_format::general, this->M_digits).ptr;
+    }
+
+    // characters of the largest index below `len`
+    static std::size_t index_digits(const std::size_t &len)
+    {
+        std::size_t digits = 1;
+        for (std::size_t i = len > 1 ? len - 1 : 0; i >= 10; i /= 10)
+            digits++;
+        return digits;
+    }
+
+    // longest real: %g with d digits takes at most d + 7 characters (the sign, the point and "e-308"), the shortest form at most 24 ("-1.2345678901234567e-308")
+    static std::size_t real_chars(const int &digits)
+    {
+        return digits == text_writer::shortest ? 24 : static_cast<std::size_t>(digits) + 7;
+    }
+
+    // longest "i=(re,im)\n" line, times the number of lines
+    std::size_t text_writer::state_bytes(const std::size_t &len, const std::size_t &lines) const
+    {
+        return bytes_of(lines, index_digits(len) + 4 + 2 * real_chars(this->M_digits) + 1);
+    }
+
+    // longest "i=p\n" line, times the number of lines
+    std::size_t text_writer::probabilities_bytes(const std::size_t &len, const std::size_t &lines) const
+    {
+        return bytes_of(lines, index_digits(len) + 2 + real_chars(this->M_digits));
+    }
+
+    void text_writer::header(std::string &out, const std::size_t &no_qubits, const sparse_filter &sparse) const
+    {
+        if (!sparse.enabled())
+            return;
+        out.append("qubits=");
+        out.append(std::to_string(no_qubits));
+        out.push_back('\n');
+    }
+
+    // calls fn(i) for every index i < len, or for every index of `indices` when the filter is enabled
+    template <typename Fn>
+    static void each_index(const sparse_filter &sparse, const std::vector<std::size_t> &indices, const std::size_t &len, Fn &&fn)
+    {
+        if (sparse.enabled())
+            for (const std::size_t &i : indices)
+                fn(i);
+        else
+            for (std::size_t i = 0; i < len; i++)
+                fn(i);
+    }
+
+    void text_writer::state(std::string &out, const std::string &label, const qubit &q, const sparse_filter &sparse) const
+    {
+        const qubit::complex *amps = q.get_qubits();
+        std::vector<std::size_t> indices;
+        if (sparse.enabled())
+            sparse.select(amps, q.get_size(), indices);
+        const std::size_t lines = sparse.enabled() ? indices.size() : q.get_size();
+
+        out.append(label);
+        out.push_back('\n');
+        const std::size_t at = out.size();
+        out.resize_and_overwrite(at + this->state_bytes(q.get_size(), lines), [&](char *buf, const std::size_t &)
+                                 {
+                                     char *p = buf + at;
+                                     each_index(sparse, indices, q.get_size(), [&](const std::size_t &i)
+                                                {
+                                                    p = std::to_chars(p, p + 20, i).ptr;
+                                                    *p++ = '=';
+                                                    *p++ = '(';
+                                                    p = this->real(p, amps[i].real());
+                                                    *p++ = ',';
+                                                    p = this->real(p, amps[i].imag());
+                                                    *p++ = ')';
+                                                    *p++ = '\n'; });
+                                     return static_cast<std::size_t>(p - buf); });
+    }
+
+    void text_writer::probabilities(std::string &out, const double *probs, const std::size_t &len, const sparse_filter &sparse) const
+    {
+        std::vector<std::size_t> indices;
+        if (sparse.enabled())
+            sparse.select(probs, len, indices);
+        const std::size_t lines = sparse.enabled() ? indices.size() : len;
+
+        out.append("prob\n");
+        const std::size_t at = out.size();
+        out.resize_and_overwrite(at + this->probabilities_bytes(len, lines), [&](char *buf, const std::size_t &)
+                                 {
+                                     char *p = buf + at;
+                                     each_index(sparse, indices, len, [&](const std::size_t &i)
+                                                {
+                                                    p = std::to_chars(p, p + 20, i).ptr;
+                                                    *p++ = '=';
+                                                    p = this->real(p, probs[i]);
+                                                    *p++ = '\n'; });
+                                     return static_cast<std::size_t>(p - buf); });
+    }
+
+    void text_writer::counts(std::string &out, const qubit::histogram &hist) const
+    {
+        out.append("counts\n");
+        const std::size_t at = out.size();
+        out.resize_and_overwrite(at + hist.size() * (20 + 1 + 20 + 1), [&](char *buf, const std::size_t &)
+                                 {
+                                     char *p = buf + at;
+                                     for (const auto &[i, c] : hist)
+                                     {
+                                         p = std::to_chars(p, p + 20, i).ptr;
+                                         *p++ = '=';
+                                         p = std::to_chars(p, p + 20, c).ptr;
+                                         *p++ = '\n';
+                                     }
+                                     return static_cast<std::size_t>(p - buf); });
+    }
+
+    void text_writer::measurement(std::string &out, const std::size_t &outcome) const
+    {
+        out.append("measure\n");
+        out.append(std::to_string(outcome));
+        out.push_back('\n');
+    }
+}
@@ -0,0 +1,97 @@
+/**
+ * @file format.hh
+ * @license This file is licensed under the GNU GENERAL PUBLIC LICENSE Version 3, 29 June 2007. You may obtain a copy of this license at https://www.gnu.org/licenses/gpl-3.0.en.html.
+ * @author Tushar Chaurasia (Dark-CodeX)
+ */
+
+#ifndef SIMULATOR_FORMAT
+#define SIMULATOR_FORMAT
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "../gates/gates.hh"
+
+namespace simulator
+{
+    enum reply_format : unsigned char
+    {
+        TEXT,  // "label" followed by "i=(re,im)" lines, read by the visualizer
+        BINARY // application/octet-stream, see binary_writer
+    };
+
+    // selects the entries worth sending for mostly-empty states: weights (|amplitude|^2 or probabilities) above `epsilon`, and of those only the `top` largest
+    // the default filter keeps every entry
+    struct sparse_filter
+    {
+        double M_epsilon = -1.0; // negative: no threshold
+        std::size_t M_top = 0;   // 0: no limit
+
+        bool enabled() const;
+        // ascending indices of the kept entries of `weights`
+        void select(const double *weights, const std::size_t &len, std::vector<std::size_t> &indices) const;
+        void select(const qubit::complex *amps, const std::size_t &len, std::vector<std::size_t> &indices) const;
+    };
+
+    // text reply: the snapshot label on its own line, then "i=(re,im)" per amplitude, "prob" followed by "i=p" lines, "counts" followed by "i=c" lines, "measure" followed by the outcome
+    // numbers are written with std::to_chars straight into the reply, which is grown once per snapshot to its worst-case size
+    // a sparse reply starts with a "qubits=N" line and leaves out the lines of the filtered entries, which the reader takes as 0
+    class text_writer
+    {
+      private:
+        int M_digits;
+
+        char *real(char *p, const double &v) const;
+
+      public:
+        static constexpr int shortest = 0;
+
+        // `digits` significant digits (as printf's %g), or `shortest` for the shortest text that reads back to the same double
+        // 6 gives the output of the iostream defaults
+        text_writer(const int &digits = 6);
+        void header(std::string &out, const std::size_t &no_qubits, const sparse_filter &sparse) const;
+        void state(std::string &out, const std::string &label, const qubit &q, const sparse_filter &sparse = {}) const;
+        void probabilities(std::string &out, const double *probs, const std::size_t &len, const sparse_filter &sparse = {}) const;
+        void counts(std::string &out, const qubit::histogram &hist) const;
+        void measurement(std::string &out, const std::size_t &outcome) const;
+        // most bytes state() and probabilities() append for `len` entries of which `lines` are written, the label aside
+        std::size_t state_bytes(const std::size_t &len, const std::size_t &lines) const;
+        std::size_t probabilities_bytes(const std::size_t &len, const std::size_t &lines) const;
+    };
+
+    // little-endian binary reply, every offset is a multiple of 8 so the arrays can be viewed in place as Float64Array / Float32Array
+    // header (8 bytes):  "QVB1", u32 number of qubits
+    // frame (16 bytes):  u8 kind, u8 bytes per real (8 or 4, 0 for MEASUREMENT), u16 0, u32 label length, u64 element count
+    //                    then the label padded to 8 bytes, then the elements padded to 8 bytes
+    // STATE frames hold `count` interleaved (re, im) pairs, PROBABILITIES frames `count` reals, the MEASUREMENT frame a single u64 outcome
+    // SPARSE_STATE and SPARSE_PROBABILITIES frames hold `count` u64 ascending indices first, then the entries at those indices, the others are 0
+    // the COUNTS frame holds `count` u64 ascending basis states, then their `count` u64 counts (bytes per real is 8)
+    class binary_writer
+    {
+      public:
+        enum frame_kind : std::uint8_t
+        {
+            STATE = 1,
+            PROBABILITIES = 2,
+            MEASUREMENT = 3,
+            SPARSE_STATE = 4,
+            SPARSE_PROBABILITIES = 5,
+            COUNTS = 6
+        };
+
+        static constexpr const char *content_type = "application/octet-stream";
+
+        static void header(std::string &out, const std::size_t &no_qubits);
+        // the reals are written in the precision of `q`
+        static void state(std::string &out, const std::string &label, const qubit &q, const sparse_filter &sparse = {});
+        static void probabilities(std::string &out, const double *probs, const std::size_t &len, const state_precision &precision, const sparse_filter &sparse = {});
+        static void counts(std::string &out, const qubit::histogram &hist);
+        static void measurement(std::string &out, const std::size_t &outcome);
+        // most bytes state() and probabilities() append for `len` entries of which `lines` are written (all of them when `sparse` is disabled), the label aside
+        static std::size_t state_bytes(const std::size_t &len, const std::size_t &lines, const state_precision &precision, const sparse_filter &sparse);
+        static std::size_t probabilities_bytes(const std::size_t &len, const std::size_t &lines, const state_precision &precision, const sparse_filter &sparse);
+    };
+}
+
+#endif
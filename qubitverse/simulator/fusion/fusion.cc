@@ -0,0 +1,178 @@
+/**
+ * @file fusion.cc
+ * @license This file is licensed under the GNU GENERAL PUBLIC LICENSE Version 3, 29 June 2007. You may obtain a copy of this license at https://www.gnu.org/licenses/gpl-3.0.en.html.
+ * @author Tushar Chaurasia (Dark-CodeX)
+ */
+
+#include "./fusion.hh"
+#include "../gates/kernels.hh"
+
+namespace simulator
+{
+    fusion::fusion(const std::size_t &max_qubits)
+        : M_max_qubits(std::min(max_qubits, fusion::max_fused_qubits)) {}
+
+    // qubits a gate acts on, left empty for gates that cannot be fused (measurements, unknown gates)
+    void fusion::get_qubits(const ast_node *node, std::vector<std::size_t> &qubits)
+    {
+        std::size_t q1 = 0, q2 = 0;
+        if (node->get_gate_type() == gate_type::SINGLE_GATE)
+        {
+            auto *casted = dynamic_cast<const ast_single_gate_node *>(node);
+            qubit::complex m[2][2];
+            if (qubit::get_gate_matrix(m, casted->M_gate, 0.0))
+                qubits.push_back(casted->M_qubit);
+            return;
+        }
+        else if (node->get_gate_type() == gate_type::CNOT_GATE)
+        {
+            auto *casted = dynamic_cast<const ast_cnot_gate_node *>(node);
+            q1 = casted->M_control;
+            q2 = casted->M_target;
+        }
+        else if (node->get_gate_type() == gate_type::CZ_GATE)
+        {
+            auto *casted = dynamic_cast<const ast_cz_gate_node *>(node);
+            q1 = casted->M_control;
+            q2 = casted->M_target;
+        }
+        else if (node->get_gate_type() == gate_type::SWAP_GATE)
+        {
+            auto *casted = dynamic_cast<const ast_swap_gate_node *>(node);
+            q1 = casted->M_qubit1;
+            q2 = casted->M_qubit2;
+        }
+        else if (node->get_gate_type() == gate_type::CONTROLLED_GATE)
+        {
+            auto *casted = dynamic_cast<const ast_controlled_gate_node *>(node);
+            qubit::complex m[2][2];
+            if (!qubit::get_gate_matrix(m, casted->M_gate, 0.0))
+                return;
+            qubits.push_back(casted->M_target);
+            for (const std::size_t &c : casted->M_controls)
+                if (std::find(qubits.begin(), qubits.end(), c) == qubits.end())
+                    qubits.push_back(c);
+            return;
+        }
+        else
+            return;
+
+        qubits.push_back(q1);
+        if (q2 != q1)
+            qubits.push_back(q2);
+    }
+
+    std::size_t fusion::local_index(const std::vector<std::size_t> &targets, const std::size_t &q)
+    {
+        return static_cast<std::size_t>(std::find(targets.begin(), targets.end(), q) - targets.begin());
+    }
+
+    // applies `node` on a column of the fused matrix, i.e. on a state-vector over the qubits `targets`, using the same kernels as the full state-vector
+    void fusion::apply_to_column(qubit::complex *__col, const std::size_t &dim, const std::vector<std::size_t> &targets, const ast_node *node)
+    {
+        const kernels::aos_state col{__col};
+        if (node->get_gate_type() == gate_type::SINGLE_GATE)
+        {
+            auto *casted = dynamic_cast<const ast_single_gate_node *>(node);
+            qubit::complex m[2][2];
+            qubit::get_gate_matrix(m, casted->M_gate, deg_to_rad(casted->M_theta));
+            kernels::apply_2x2(col, dim, m, fusion::local_index(targets, casted->M_qubit));
+        }
+        else if (node->get_gate_type() == gate_type::CNOT_GATE)
+        {
+            auto *casted = dynamic_cast<const ast_cnot_gate_node *>(node);
+            kernels::apply_cnot(col, dim, fusion::local_index(targets, casted->M_control), fusion::local_index(targets, casted->M_target));
+        }
+        else if (node->get_gate_type() == gate_type::CZ_GATE)
+        {
+            auto *casted = dynamic_cast<const ast_cz_gate_node *>(node);
+            kernels::apply_controlled_phase(col, dim, -1.0, fusion::local_index(targets, casted->M_control), fusion::local_index(targets, casted->M_target));
+        }
+        else if (node->get_gate_type() == gate_type::SWAP_GATE)
+        {
+            auto *casted = dynamic_cast<const ast_swap_gate_node *>(node);
+            kernels::apply_swap(col, dim, fusion::local_index(targets, casted->M_qubit1), fusion::local_index(targets, casted->M_qubit2));
+        }
+        else if (node->get_gate_type() == gate_type::CONTROLLED_GATE)
+        {
+            auto *casted = dynamic_cast<const ast_controlled_gate_node *>(node);
+            qubit::complex m[2][2];
+            qubit::get_gate_matrix(m, casted->M_gate, deg_to_rad(casted->M_theta));
+            std::vector<std::size_t> controls;
+            for (const std::size_t &c : casted->M_controls)
+                controls.push_back(fusion::local_index(targets, c));
+            kernels::apply_controlled_2x2(col, dim, controls.data(), controls.size(), m, fusion::local_index(targets, casted->M_target));
+        }
+    }
+
+    void fusion::flush(fused_gate &block)
+    {
+        if (block.M_gates.empty())
+            return;
+
+        if (block.M_gates.size() > 1)
+        {
+            // column c of the product is the image of the basis state |c>
+            const std::size_t dim = static_cast<std::size_t>(1) << block.M_targets.size();
+            std::vector<qubit::complex> cols(dim * dim, 0.0);
+            for (std::size_t c = 0; c < dim; c++)
+            {
+                cols[c * dim + c] = 1.0;
+                for (const ast_node *node : block.M_gates)
+                    fusion::apply_to_column(cols.data() + c * dim, dim, block.M_targets, node);
+            }
+
+            block.M_matrix.resize(dim * dim);
+            for (std::size_t r = 0; r < dim; r++)
+                for (std::size_t c = 0; c < dim; c++)
+                    block.M_matrix[r * dim + c] = cols[c * dim + r];
+        }
+
+        this->M_blocks.emplace_back(std::move(block));
+        block = fused_gate();
+    }
+
+    void fusion::perform(const std::vector<std::unique_ptr<ast_node>> &gates, const std::vector<bool> &cut_after)
+    {
+        this->M_blocks.clear();
+        this->M_blocks.reserve(gates.size());
+
+        fused_gate current;
+        std::vector<std::size_t> qubits;
+        for (std::size_t g = 0; g < gates.size(); g++)
+        {
+            const std::unique_ptr<ast_node> &i = gates[g];
+            qubits.clear();
+            fusion::get_qubits(i.get(), qubits);
+
+            if (qubits.empty())
+            {
+                this->flush(current);
+                current.M_gates.push_back(i.get());
+                this->flush(current);
+                continue;
+            }
+
+            std::vector<std::size_t> merged = current.M_targets;
+            for (const std::size_t &q : qubits)
+                if (std::find(merged.begin(), merged.end(), q) == merged.end())
+                    merged.push_back(q);
+
+            if (!current.M_gates.empty() && merged.size() > this->M_max_qubits)
+            {
+                this->flush(current);
+                merged = qubits;
+            }
+            current.M_targets = std::move(merged);
+            current.M_gates.push_back(i.get());
+            if (g < cut_after.size() && cut_after[g])
+                this->flush(current);
+        }
+        this->flush(current);
+    }
+
+    std::vector<fused_gate> &fusion::get()
+    {
+        return this->M_blocks;
+    }
+}
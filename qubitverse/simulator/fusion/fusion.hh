@@ -0,0 +1,49 @@
+/**
+ * @file fusion.hh
+ * @license This file is licensed under the GNU GENERAL PUBLIC LICENSE Version 3, 29 June 2007. You may obtain a copy of this license at https://www.gnu.org/licenses/gpl-3.0.en.html.
+ * @author Tushar Chaurasia (Dark-CodeX)
+ */
+
+#ifndef SIMULATOR_FUSION
+#define SIMULATOR_FUSION
+
+#include <vector>
+#include <memory>
+#include "../gates/gates.hh"
+#include "../parser/ast.hh"
+
+namespace simulator
+{
+    // a run of consecutive gates that is applied to the state-vector in one pass
+    struct fused_gate
+    {
+        std::vector<const ast_node *> M_gates;  // gates of the run, in circuit order
+        std::vector<std::size_t> M_targets;     // qubits touched by the run, M_targets[0] is the least significant bit of the matrix index
+        std::vector<qubit::complex> M_matrix;   // 2^k x 2^k row-major product of the run, empty when the run has a single gate
+    };
+
+    // greedily merges consecutive single-qubit, two-qubit and controlled gates into dense unitaries acting on at most `max_qubits` qubits
+    // measurements are never fused and split the runs around them, so does every gate `g` with cut_after[g] set (the state after it must be observable)
+    class fusion
+    {
+      private:
+        std::size_t M_max_qubits;
+        std::vector<fused_gate> M_blocks;
+
+        static void get_qubits(const ast_node *node, std::vector<std::size_t> &qubits);
+        static std::size_t local_index(const std::vector<std::size_t> &targets, const std::size_t &q);
+        static void apply_to_column(qubit::complex *col, const std::size_t &dim, const std::vector<std::size_t> &targets, const ast_node *node);
+        void flush(fused_gate &block);
+
+      public:
+        static constexpr std::size_t max_fused_qubits = 5;
+
+        fusion() = delete;
+        fusion(const std::size_t &max_qubits);
+        void perform(const std::vector<std::unique_ptr<ast_node>> &gates, const std::vector<bool> &cut_after = {});
+        [[nodiscard]] std::vector<fused_gate> &get();
+        ~fusion() = default;
+    };
+}
+
+#endif
@@ -0,0 +1,258 @@
+/**
+ * @file allocator.cc
+ * @license This file is licensed under the GNU GENERAL PUBLIC LICENSE Version 3, 29 June 2007. You may obtain a copy of this license at https://www.gnu.org/licenses/gpl-3.0.en.html.
+ * @author Tushar Chaurasia (Dark-CodeX)
+ */
+
+#include "./allocator.hh"
+#include <new>
+#include <cstring>
+#include <limits>
+#include <cstdint>
+#include <cstdlib>
+#include <cerrno>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+namespace simulator
+{
+    static huge_page_allocator default_huge_page_allocator;
+    static aligned_allocator default_aligned_allocator;
+    static state_allocator *default_allocator = &default_huge_page_allocator;
+
+    state_allocator &state_allocator::get_default()
+    {
+        return *default_allocator;
+    }
+
+    void state_allocator::set_default(state_allocator &alloc)
+    {
+        default_allocator = &alloc;
+    }
+
+    state_allocator *state_allocator::from_name(const char *name)
+    {
+        if (std::strcmp(name, "hugepages") == 0)
+            return &default_huge_page_allocator;
+        if (std::strcmp(name, "aligned") == 0)
+            return &default_aligned_allocator;
+        return nullptr;
+    }
+
+    std::size_t state_allocator::physical_memory()
+    {
+#if defined(_SC_PHYS_PAGES) && defined(_SC_PAGESIZE)
+        const long pages = sysconf(_SC_PHYS_PAGES), page_size = sysconf(_SC_PAGESIZE);
+        if (pages > 0 && page_size > 0)
+            return static_cast<std::size_t>(pages) * static_cast<std::size_t>(page_size);
+#endif
+        return std::numeric_limits<std::size_t>::max();
+    }
+
+    bool state_allocator::parse_mib(const char *str, std::size_t &bytes)
+    {
+        // strtoull would accept leading blanks and a sign, and wrap a negative number around
+        if (!str || *str < '0' || *str > '9')
+            return false;
+        char *end = nullptr;
+        errno = 0;
+        const unsigned long long mib = std::strtoull(str, &end, 10);
+        if (*end != '\0')
+            return false;
+        if (errno == ERANGE || mib > (std::numeric_limits<std::size_t>::max() >> 20))
+            bytes = std::numeric_limits<std::size_t>::max();
+        else
+            bytes = static_cast<std::size_t>(mib) << 20;
+        return true;
+    }
+
+    void state_allocator::discard(void *, const std::size_t &)
+    {
+    }
+
+    void huge_page_allocator::discard(void *ptr, const std::size_t &bytes)
+    {
+#if defined(MADV_DONTNEED)
+        // whole huge pages are whole pages of every smaller size too, and MAP_HUGETLB mappings accept nothing less
+        const std::uintptr_t first = reinterpret_cast<std::uintptr_t>(ptr), page = huge_page_allocator::huge_page;
+        const std::uintptr_t begin = (first + page - 1) & ~(page - 1), end = (first + bytes) & ~(page - 1);
+        if (begin < end)
+            madvise(reinterpret_cast<void *>(begin), end - begin, MADV_DONTNEED);
+#else
+        (void)ptr;
+        (void)bytes;
+#endif
+    }
+
+    void *aligned_allocator::allocate(const std::size_t &bytes, const char *&policy)
+    {
+        policy = "aligned";
+        return ::operator new[](bytes, std::align_val_t{state_allocator::alignment});
+    }
+
+    void aligned_allocator::deallocate(void *ptr, const std::size_t &)
+    {
+        ::operator delete[](ptr, std::align_val_t{state_allocator::alignment});
+    }
+
+    const char *aligned_allocator::name() const
+    {
+        return "aligned";
+    }
+
+    // mappings are whole huge pages, so that the tail of the buffer is backed by one as well
+    static std::size_t round_to_huge_page(const std::size_t &bytes)
+    {
+        return (bytes + huge_page_allocator::huge_page - 1) & ~(huge_page_allocator::huge_page - 1);
+    }
+
+    void *huge_page_allocator::allocate(const std::size_t &bytes, const char *&policy)
+    {
+#if defined(MAP_ANONYMOUS)
+        if (bytes >= huge_page_allocator::huge_page)
+        {
+            const std::size_t len = round_to_huge_page(bytes);
+            void *ptr = MAP_FAILED;
+#if defined(MAP_HUGETLB)
+            ptr = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (ptr != MAP_FAILED)
+            {
+                policy = "hugetlb";
+                return ptr;
+            }
+#endif
+            ptr = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (ptr == MAP_FAILED)
+                throw std::bad_alloc();
+            policy = "mmap";
+#if defined(MADV_HUGEPAGE)
+            if (madvise(ptr, len, MADV_HUGEPAGE) == 0)
+                policy = "transparent-hugepages";
+#endif
+            return ptr;
+        }
+#endif
+        return this->M_small.allocate(bytes, policy);
+    }
+
+    void huge_page_allocator::deallocate(void *ptr, const std::size_t &bytes)
+    {
+#if defined(MAP_ANONYMOUS)
+        if (bytes >= huge_page_allocator::huge_page)
+        {
+            munmap(ptr, round_to_huge_page(bytes));
+            return;
+        }
+#endif
+        this->M_small.deallocate(ptr, bytes);
+    }
+
+    const char *huge_page_allocator::name() const
+    {
+        return "hugepages";
+    }
+
+    pooled_allocator::pooled_allocator(state_allocator &upstream, const std::size_t &capacity)
+        : M_upstream(upstream), M_capacity(capacity) {}
+
+    void *pooled_allocator::allocate(const std::size_t &bytes, const char *&policy)
+    {
+        std::lock_guard<std::mutex> guard(this->M_lock);
+        for (std::size_t i = this->M_idle.size(); i-- > 0;)
+        {
+            if (this->M_idle[i].M_bytes != bytes)
+                continue;
+            const block b = this->M_idle[i];
+            this->M_idle.erase(this->M_idle.begin() + static_cast<std::ptrdiff_t>(i));
+            this->M_live.push_back(b);
+            this->M_retained -= bytes;
+            this->M_hits++;
+            policy = b.M_policy;
+            return b.M_ptr;
+        }
+        this->M_misses++;
+        void *ptr = this->M_upstream.allocate(bytes, policy);
+        this->M_live.push_back({ptr, bytes, policy});
+        return ptr;
+    }
+
+    void pooled_allocator::deallocate(void *ptr, const std::size_t &bytes)
+    {
+        std::vector<block> evicted;
+        {
+            std::lock_guard<std::mutex> guard(this->M_lock);
+            std::size_t l = 0;
+            while (l < this->M_live.size() && this->M_live[l].M_ptr != ptr)
+                l++;
+
+            // not handed out by the pool (allocated before it was installed, say): it goes straight back where it came from
+            if (l == this->M_live.size())
+                evicted.push_back({ptr, bytes, nullptr});
+            else if (bytes > this->M_capacity)
+            {
+                evicted.push_back(this->M_live[l]);
+                this->M_live.erase(this->M_live.begin() + static_cast<std::ptrdiff_t>(l));
+            }
+            else
+            {
+                const block b = this->M_live[l];
+                this->M_live.erase(this->M_live.begin() + static_cast<std::ptrdiff_t>(l));
+                std::size_t n = 0;
+                while (this->M_retained + bytes > this->M_capacity)
+                {
+                    this->M_retained -= this->M_idle[n].M_bytes;
+                    evicted.push_back(this->M_idle[n++]);
+                }
+                this->M_idle.erase(this->M_idle.begin(), this->M_idle.begin() + static_cast<std::ptrdiff_t>(n));
+                this->M_idle.push_back(b);
+                this->M_retained += bytes;
+            }
+        }
+        // munmap and free can be slow for large buffers, they are called outside of the lock
+        for (const block &b : evicted)
+            this->M_upstream.deallocate(b.M_ptr, b.M_bytes);
+    }
+
+    const char *pooled_allocator::name() const
+    {
+        return "pooled";
+    }
+
+    void pooled_allocator::trim()
+    {
+        std::vector<block> evicted;
+        {
+            std::lock_guard<std::mutex> guard(this->M_lock);
+            evicted.swap(this->M_idle);
+            this->M_retained = 0;
+        }
+        for (const block &b : evicted)
+            this->M_upstream.deallocate(b.M_ptr, b.M_bytes);
+    }
+
+    std::size_t pooled_allocator::retained() const
+    {
+        std::lock_guard<std::mutex> guard(this->M_lock);
+        return this->M_retained;
+    }
+
+    std::size_t pooled_allocator::hits() const
+    {
+        std::lock_guard<std::mutex> guard(this->M_lock);
+        return this->M_hits;
+    }
+
+    std::size_t pooled_allocator::misses() const
+    {
+        std::lock_guard<std::mutex> guard(this->M_lock);
+        return this->M_misses;
+    }
+
+    pooled_allocator::~pooled_allocator()
+    {
+        this->trim();
+    }
+}
@@ -0,0 +1,112 @@
+/**
+ * @file allocator.hh
+ * @license This file is licensed under the GNU GENERAL PUBLIC LICENSE Version 3, 29 June 2007. You may obtain a copy of this license at https://www.gnu.org/licenses/gpl-3.0.en.html.
+ * @author Tushar Chaurasia (Dark-CodeX)
+ */
+
+#ifndef SIMULATOR_ALLOCATOR
+#define SIMULATOR_ALLOCATOR
+
+#include <cstddef>
+#include <vector>
+#include <mutex>
+
+namespace simulator
+{
+    // source of the memory of every state-vector, the buffers it returns are 64-byte aligned and NOT initialized
+    // qubit zeroes them in parallel, so that every page is first touched by the thread (and the NUMA node) that later runs the kernels on it
+    class state_allocator
+    {
+      public:
+        static constexpr std::size_t alignment = 64;
+
+        // `policy` receives a short description of how this particular buffer was obtained
+        virtual void *allocate(const std::size_t &bytes, const char *&policy) = 0;
+        virtual void deallocate(void *ptr, const std::size_t &bytes) = 0;
+        virtual const char *name() const = 0;
+        virtual ~state_allocator() = default;
+
+        // allocator used by the qubit constructor, huge_page_allocator unless replaced
+        static state_allocator &get_default();
+        static void set_default(state_allocator &alloc);
+
+        // "aligned" or "hugepages", nullptr for an unknown name
+        static state_allocator *from_name(const char *name);
+
+        // physical memory of the machine in bytes, SIZE_MAX when it cannot be queried
+        static std::size_t physical_memory();
+
+        // parses a decimal count of MiB into `bytes`, saturating at SIZE_MAX; false when `str` is not (entirely) a non-negative number
+        static bool parse_mib(const char *str, std::size_t &bytes);
+
+        // may hand the physical memory of [ptr, ptr + bytes) of one of its buffers back to the system, the range stays allocated but its content is lost
+        // does nothing by default: heap buffers are not ours to unmap, and pooled ones are kept faulted in on purpose
+        virtual void discard(void *ptr, const std::size_t &bytes);
+    };
+
+    // 64-byte aligned operator new
+    class aligned_allocator : public state_allocator
+    {
+      public:
+        void *allocate(const std::size_t &bytes, const char *&policy) override;
+        void deallocate(void *ptr, const std::size_t &bytes) override;
+        const char *name() const override;
+    };
+
+    // anonymous mappings backed by huge pages, which cut the TLB misses of the large-stride gates
+    // MAP_HUGETLB is tried first (it needs pages reserved in /proc/sys/vm/nr_hugepages), then a regular mapping with madvise(MADV_HUGEPAGE) for transparent huge pages
+    // buffers smaller than one huge page, and platforms without mmap, fall back to aligned_allocator
+    class huge_page_allocator : public state_allocator
+    {
+      private:
+        aligned_allocator M_small;
+
+      public:
+        static constexpr std::size_t huge_page = static_cast<std::size_t>(1) << 21;
+
+        void *allocate(const std::size_t &bytes, const char *&policy) override;
+        void deallocate(void *ptr, const std::size_t &bytes) override;
+        const char *name() const override;
+        // madvise(MADV_DONTNEED) on the whole huge pages of the range, which read as zeros once touched again
+        void discard(void *ptr, const std::size_t &bytes) override;
+    };
+
+    // keeps released buffers (already faulted in) for the next state-vector of the same size, instead of handing them back to `upstream`
+    // buffer sizes are powers of two times 8 or 16 bytes, so the exact size is the size class
+    // idle buffers are limited to `capacity` bytes in total, the least recently released ones go back to `upstream` first
+    // thread-safe, one pool is shared by all the requests of the server
+    class pooled_allocator : public state_allocator
+    {
+      private:
+        struct block
+        {
+            void *M_ptr;
+            std::size_t M_bytes;
+            const char *M_policy;
+        };
+
+        state_allocator &M_upstream;
+        std::size_t M_capacity, M_retained = 0;
+        std::size_t M_hits = 0, M_misses = 0;
+        std::vector<block> M_idle; // least recently released first
+        std::vector<block> M_live; // checked out, remembers the policy of each buffer until it comes back
+        mutable std::mutex M_lock;
+
+      public:
+        pooled_allocator() = delete;
+        pooled_allocator(state_allocator &upstream, const std::size_t &capacity);
+        pooled_allocator(const pooled_allocator &) = delete;
+        pooled_allocator &operator=(const pooled_allocator &) = delete;
+        void *allocate(const std::size_t &bytes, const char *&policy) override;
+        void deallocate(void *ptr, const std::size_t &bytes) override;
+        const char *name() const override;
+        // hands every idle buffer back to the upstream allocator
+        void trim();
+        std::size_t retained() const;
+        std::size_t hits() const;
+        std::size_t misses() const;
+        ~pooled_allocator();
+    };
+}
+
+#endif
@@ -5,30 +5,120 @@
  */
 
 #include "./gates.hh"
+#include "./kernels.hh"
+#include "./thread_pool.hh"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
 
 namespace simulator
 {
-    void qubit::apply_predefined_gate(complex *&__s, const std::size_t &_len, const gate_type &__g_type, const std::size_t &qubit_target)
+    template <typename Fn>
+    void qubit::visit(Fn &&fn) const
     {
-        const std::size_t stride = 1 << qubit_target; // Distance between paired indices
+        if (this->M_layout == state_layout::SOA && this->M_precision == state_precision::FP32)
+            fn(kernels::soa_state<float>{static_cast<float *>(this->M_data[0]), static_cast<float *>(this->M_data[1])});
+        else if (this->M_layout == state_layout::SOA)
+            fn(kernels::soa_state<double>{static_cast<double *>(this->M_data[0]), static_cast<double *>(this->M_data[1])});
+        else if (this->M_precision == state_precision::FP32)
+            fn(kernels::aos_state<float>{static_cast<std::complex<float> *>(this->M_data[0])});
+        else
+            fn(kernels::aos_state<double>{static_cast<complex *>(this->M_data[0])});
+    }
 
-        for (std::size_t i = 0; i < _len; i += 2 * stride)
+    static std::size_t default_memory_budget()
+    {
+        if (const char *env = std::getenv("QUBITVERSE_MEMORY_BUDGET_MB"))
         {
-            for (std::size_t j = 0; j < stride; ++j)
-            {
-                std::size_t idx0 = i + j;
-                std::size_t idx1 = i + j + stride;
+            std::size_t bytes = 0;
+            if (state_allocator::parse_mib(env, bytes) && bytes != 0)
+                return bytes;
+            std::fprintf(stderr, "warning: QUBITVERSE_MEMORY_BUDGET_MB='%s' is not a positive number of MiB, the physical memory is used instead\n", env);
+        }
+        return state_allocator::physical_memory();
+    }
 
-                // Apply the gate to the two elements
-                complex a = __s[idx0];
-                complex b = __s[idx1];
+    std::size_t qubit::M_memory_budget = default_memory_budget();
 
-                __s[idx0] = pre_defined_qgates[static_cast<std::size_t>(__g_type)].matrix[0][0] * a + pre_defined_qgates[static_cast<std::size_t>(__g_type)].matrix[0][1] * b;
-                __s[idx1] = pre_defined_qgates[static_cast<std::size_t>(__g_type)].matrix[1][0] * a + pre_defined_qgates[static_cast<std::size_t>(__g_type)].matrix[1][1] * b;
-            }
+    // invalid arguments are thrown as `E` rather than ending the process, a server using the library answers the request that caused them instead
+    template <typename E, typename... Args>
+    [[noreturn]] static void fail(const char *fmt, const Args &...args)
+    {
+        char msg[192];
+        std::snprintf(msg, sizeof(msg), fmt, args...);
+        throw E(msg);
+    }
+
+    // throws if `q` is not one of the qubits of a state-vector of `_len` amplitudes
+    static void check_qubit(const std::size_t &q, const std::size_t &_len)
+    {
+        if (q >= static_cast<std::size_t>(std::numeric_limits<std::size_t>::digits) || (std::size_t(1) << q) >= _len)
+            fail<std::out_of_range>("qubit %zu does not exist in a %zu qubit-system", q, (std::size_t)std::log2(_len));
+    }
+
+    // bytes of each of the (one or two) buffers holding the state-vector
+    static std::size_t buffer_size(const std::size_t &_len, const state_layout &layout, const state_precision &precision)
+    {
+        const std::size_t real = precision == state_precision::FP32 ? sizeof(float) : sizeof(double);
+        return layout == state_layout::SOA ? real * _len : 2 * real * _len;
+    }
+
+    void qubit::allocate()
+    {
+        this->M_data[0] = this->M_data[1] = nullptr;
+        this->M_policy = "none";
+        this->M_capacity = this->M_len;
+        if (this->M_len == 0)
+            return;
+
+        const std::size_t bytes = buffer_size(this->M_len, this->M_layout, this->M_precision), size = bytes / this->M_len;
+        for (std::size_t b = 0; b < (this->M_layout == state_layout::SOA ? 2 : 1); b++)
+        {
+            this->M_data[b] = this->M_alloc->allocate(bytes, this->M_policy);
+            // first touch: each worker zeroes the pages it will later update, which places them on its own NUMA node
+            // split by amplitude like the kernels are, on 4 KiB boundaries (every element size divides 4096)
+            unsigned char *buf = static_cast<unsigned char *>(this->M_data[b]);
+            thread_pool::instance().parallel_for(0, this->M_len, 4096 / size, 1, [buf, size](const std::size_t &begin, const std::size_t &end)
+                                                 { std::memset(buf + begin * size, 0, (end - begin) * size); });
         }
     }
 
+    void qubit::release()
+    {
+        for (void *&buf : this->M_data)
+        {
+            if (buf)
+                this->M_alloc->deallocate(buf, buffer_size(this->M_capacity, this->M_layout, this->M_precision));
+            buf = nullptr;
+        }
+        this->M_view.clear();
+        this->M_view.shrink_to_fit();
+    }
+
+    bool qubit::is_diagonal(const gate_type &__g_type)
+    {
+        return __g_type == gate_type::PAULI_Z || __g_type == gate_type::PHASE_PI_2_SHIFT || __g_type == gate_type::PHASE_PI_4_SHIFT || __g_type == gate_type::PHASE_GENERAL_SHIFT || __g_type == gate_type::ROTATION_Z;
+    }
+
+    template <typename S>
+    void qubit::apply_predefined_gate(const S &__s, const std::size_t &_len, const gate_type &__g_type, const std::size_t &qubit_target)
+    {
+        const qgate_2x2 &__g = pre_defined_qgates[static_cast<std::size_t>(__g_type)];
+        check_qubit(qubit_target, _len);
+        if (__g_type == gate_type::IDENTITY)
+            return;
+        if (__g_type == gate_type::PAULI_X)
+            kernels::apply_pauli_x(__s, _len, qubit_target);
+        else if (__g_type == gate_type::PAULI_Y)
+            kernels::apply_pauli_y(__s, _len, qubit_target);
+        else if (qubit::is_diagonal(__g_type))
+            kernels::apply_diagonal(__s, _len, __g.matrix[0][0], __g.matrix[1][1], qubit_target);
+        else
+            kernels::apply_2x2(__s, _len, __g.matrix, qubit_target);
+    }
+
     qubit::qgate_2x2 &qubit::get_theta_gate(qgate_2x2 &__g, const gate_type &__g_type, const double &__theta)
     {
         __g.type = __g_type;
@@ -63,213 +153,339 @@ namespace simulator
             break;
 
         default:
-            std::fprintf(stderr, "error: invalid gate selected '%u'\n", (unsigned)__g_type);
-            std::exit(EXIT_FAILURE);
+            fail<std::invalid_argument>("invalid gate selected '%u'", (unsigned)__g_type);
         }
         return __g;
     }
 
-    void qubit::apply_theta_gate(complex *&__s, const std::size_t &_len, const gate_type &__g_type, const double &__theta, const std::size_t &qubit_target)
+    template <typename S>
+    void qubit::apply_theta_gate(const S &__s, const std::size_t &_len, const gate_type &__g_type, const double &__theta, const std::size_t &qubit_target)
     {
-        const std::size_t stride = 1 << qubit_target; // Distance between paired indices
+        check_qubit(qubit_target, _len);
         qgate_2x2 __g;
         __g = qubit::get_theta_gate(__g, __g_type, __theta);
-
-        for (std::size_t i = 0; i < _len; i += 2 * stride)
-        {
-            for (std::size_t j = 0; j < stride; ++j)
-            {
-                std::size_t idx0 = i + j;
-                std::size_t idx1 = i + j + stride;
-
-                // Apply the gate to the two elements
-                complex a = __s[idx0];
-                complex b = __s[idx1];
-
-                __s[idx0] = __g.matrix[0][0] * a + __g.matrix[0][1] * b;
-                __s[idx1] = __g.matrix[1][0] * a + __g.matrix[1][1] * b;
-            }
-        }
+        if (qubit::is_diagonal(__g_type))
+            kernels::apply_diagonal(__s, _len, __g.matrix[0][0], __g.matrix[1][1], qubit_target);
+        else
+            kernels::apply_2x2(__s, _len, __g.matrix, qubit_target);
     }
 
-    void qubit::apply_2qubit_gate(complex *&__s, const std::size_t &_len, const gate_type &__g_type, const std::size_t &q_control, const std::size_t &q_target)
+    template <typename S>
+    void qubit::apply_2qubit_gate(const S &__s, const std::size_t &_len, const gate_type &__g_type, const std::size_t &q_control, const std::size_t &q_target)
     {
         if (std::log2(_len) < 2.0)
-        {
-            std::fprintf(stderr, "error: specified gate operation requires a minimum of 2 qubit-system, but it was %zu qubit-system.\n", (std::size_t)std::log2(_len));
-            std::exit(EXIT_FAILURE);
-        }
+            fail<std::invalid_argument>("specified gate operation requires a minimum of 2 qubit-system, but it was %zu qubit-system", (std::size_t)std::log2(_len));
+        check_qubit(q_control, _len);
+        check_qubit(q_target, _len);
 
         if (__g_type == gate_type::CONTROLLED_NOT)
-        {
-            for (std::size_t i = 0; i < _len; i++)
-            {
-                if ((i & (1 << q_control)) != 0)
-                { // If control qubit is 1
-                    std::size_t target_bit_flipped_index = i ^ (1 << q_target);
-                    // Only swap once per pair.
-                    if (i < target_bit_flipped_index)
-                    {
-                        std::swap(__s[i], __s[target_bit_flipped_index]);
-                    }
-                }
-            }
-        }
+            kernels::apply_cnot(__s, _len, q_control, q_target);
         else if (__g_type == gate_type::CONTROLLED_Z)
-        {
-            for (std::size_t i = 0; i < _len; i++)
-            {
-                if (((i >> q_control) & 1) && ((i >> q_target) & 1))
-                {
-                    __s[i] *= -1;
-                }
-            }
-        }
+            kernels::apply_controlled_phase(__s, _len, -1.0, q_control, q_target);
         else if (__g_type == gate_type::SWAP_GATE)
+            kernels::apply_swap(__s, _len, q_control, q_target);
+    }
+
+    template <typename S>
+    void qubit::apply_controlled_gate(const S &__s, const std::size_t &_len, const std::size_t &n, const std::vector<std::size_t> &controls, const complex (&__m)[2][2], const std::size_t &q_target)
+    {
+        if (q_target >= n)
+            fail<std::out_of_range>("target qubit %zu does not exist in a %zu qubit-system", q_target, n);
+        for (const std::size_t &c : controls)
         {
-            for (std::size_t i = 0; i < _len; ++i)
-            {
-                // Extract the bits at positions q_control and q_target.
-                const std::size_t bit_q1 = (i >> q_control) & 1;
-                const std::size_t bit_q2 = (i >> q_target) & 1;
-
-                // Only need to swap if the bits differ.
-                if (bit_q1 != bit_q2)
-                {
-                    // Flip the bits at q_control and q_target.
-                    std::size_t j = i ^ ((1 << q_control) | (1 << q_target));
-                    // To avoid double swapping, swap only if i < j.
-                    if (i < j)
-                    {
-                        std::swap(__s[i], __s[j]);
-                    }
-                }
-            }
+            if (c >= n || c == q_target || std::count(controls.begin(), controls.end(), c) != 1)
+                fail<std::invalid_argument>("invalid control qubit %zu for target qubit %zu in a %zu qubit-system", c, q_target, n);
         }
+
+        kernels::apply_controlled_2x2(__s, _len, controls.data(), controls.size(), __m, q_target);
     }
 
-    qubit::qubit(const std::size_t &n)
+    qubit::qubit(const std::size_t &n, const state_layout &layout, const state_precision &precision)
     {
         if (n < 1)
-        {
-            std::fprintf(stderr, "error: at-least 1 qubit must be present in a valid quantum circuit\n");
-            std::exit(EXIT_FAILURE);
-        }
+            throw std::invalid_argument("at-least 1 qubit must be present in a valid quantum circuit");
+        const std::size_t bytes = qubit::required_memory(n, precision);
+        if (bytes > qubit::M_memory_budget)
+            fail<std::length_error>("a %zu qubit-system needs %zu MiB, which exceeds the memory budget of %zu MiB", n, bytes >> 20, qubit::M_memory_budget >> 20);
         this->M_no_qubits = n;
-        this->M_len = 1 << n;
-        this->M_qubits = new complex[this->M_len]();
-        this->M_qubits[0] = {1, 0};
+        this->M_len = std::size_t(1) << n;
+        this->M_layout = layout;
+        this->M_precision = precision;
+        this->M_alloc = &state_allocator::get_default();
+        this->allocate();
+        this->visit([](const auto &__s)
+                    { kernels::store(__s, 0, {1, 0}); });
     }
 
     qubit::qubit(const qubit &q)
+        : M_rng(q.M_rng)
     {
         this->M_len = q.M_len;
         this->M_no_qubits = q.M_no_qubits;
-        this->M_qubits = new complex[this->M_len]();
+        this->M_layout = q.M_layout;
+        this->M_precision = q.M_precision;
+        this->M_alloc = q.M_alloc;
+        this->allocate();
 
-        for (std::size_t i = 0; i < this->M_len; i++)
-        {
-            this->M_qubits[i] = q.M_qubits[i];
-        }
+        for (std::size_t b = 0; b < 2; b++)
+            if (this->M_data[b])
+                std::memcpy(this->M_data[b], q.M_data[b], buffer_size(this->M_len, this->M_layout, this->M_precision));
     }
 
     qubit::qubit(qubit &&q) noexcept(true)
+        : M_rng(q.M_rng)
     {
         this->M_len = q.M_len;
         this->M_no_qubits = q.M_no_qubits;
-        this->M_qubits = q.M_qubits;
+        this->M_layout = q.M_layout;
+        this->M_precision = q.M_precision;
+        this->M_alloc = q.M_alloc;
+        this->M_policy = q.M_policy;
+        this->M_capacity = q.M_capacity;
+        this->M_data[0] = q.M_data[0];
+        this->M_data[1] = q.M_data[1];
 
-        q.M_len = q.M_no_qubits = 0;
-        q.M_qubits = nullptr;
+        q.M_len = q.M_no_qubits = q.M_capacity = 0;
+        q.M_data[0] = q.M_data[1] = nullptr;
     }
 
     qubit &qubit::apply_identity(const std::size_t &q_target)
     {
-        qubit::apply_predefined_gate(this->M_qubits, this->M_len, gate_type::IDENTITY, q_target);
+        this->visit([&](const auto &__s)
+                    { qubit::apply_predefined_gate(__s, this->M_len, gate_type::IDENTITY, q_target); });
         return *this;
     }
 
     qubit &qubit::apply_pauli_x(const std::size_t &q_target)
     {
-        qubit::apply_predefined_gate(this->M_qubits, this->M_len, gate_type::PAULI_X, q_target);
+        this->visit([&](const auto &__s)
+                    { qubit::apply_predefined_gate(__s, this->M_len, gate_type::PAULI_X, q_target); });
         return *this;
     }
 
     qubit &qubit::apply_pauli_y(const std::size_t &q_target)
     {
-        qubit::apply_predefined_gate(this->M_qubits, this->M_len, gate_type::PAULI_Y, q_target);
+        this->visit([&](const auto &__s)
+                    { qubit::apply_predefined_gate(__s, this->M_len, gate_type::PAULI_Y, q_target); });
         return *this;
     }
 
     qubit &qubit::apply_pauli_z(const std::size_t &q_target)
     {
-        qubit::apply_predefined_gate(this->M_qubits, this->M_len, gate_type::PAULI_Z, q_target);
+        this->visit([&](const auto &__s)
+                    { qubit::apply_predefined_gate(__s, this->M_len, gate_type::PAULI_Z, q_target); });
         return *this;
     }
 
     qubit &qubit::apply_hadamard(const std::size_t &q_target)
     {
-        qubit::apply_predefined_gate(this->M_qubits, this->M_len, gate_type::HADAMARD, q_target);
+        this->visit([&](const auto &__s)
+                    { qubit::apply_predefined_gate(__s, this->M_len, gate_type::HADAMARD, q_target); });
         return *this;
     }
 
     qubit &qubit::apply_phase_pi_2_shift(const std::size_t &q_target)
     {
-        qubit::apply_predefined_gate(this->M_qubits, this->M_len, gate_type::PHASE_PI_2_SHIFT, q_target);
+        this->visit([&](const auto &__s)
+                    { qubit::apply_predefined_gate(__s, this->M_len, gate_type::PHASE_PI_2_SHIFT, q_target); });
         return *this;
     }
 
     qubit &qubit::apply_phase_pi_4_shift(const std::size_t &q_target)
     {
-        qubit::apply_predefined_gate(this->M_qubits, this->M_len, gate_type::PHASE_PI_4_SHIFT, q_target);
+        this->visit([&](const auto &__s)
+                    { qubit::apply_predefined_gate(__s, this->M_len, gate_type::PHASE_PI_4_SHIFT, q_target); });
         return *this;
     }
 
     qubit &qubit::apply_phase_general_shift(const double &_theta, const std::size_t &q_target)
     {
-        qubit::apply_theta_gate(this->M_qubits, this->M_len, gate_type::PHASE_GENERAL_SHIFT, _theta, q_target);
+        this->visit([&](const auto &__s)
+                    { qubit::apply_theta_gate(__s, this->M_len, gate_type::PHASE_GENERAL_SHIFT, _theta, q_target); });
         return *this;
     }
 
     qubit &qubit::apply_rotation_x(const double &_theta, const std::size_t &q_target)
     {
-        qubit::apply_theta_gate(this->M_qubits, this->M_len, gate_type::ROTATION_X, _theta, q_target);
+        this->visit([&](const auto &__s)
+                    { qubit::apply_theta_gate(__s, this->M_len, gate_type::ROTATION_X, _theta, q_target); });
         return *this;
     }
 
     qubit &qubit::apply_rotation_y(const double &_theta, const std::size_t &q_target)
     {
-        qubit::apply_theta_gate(this->M_qubits, this->M_len, gate_type::ROTATION_Y, _theta, q_target);
+        this->visit([&](const auto &__s)
+                    { qubit::apply_theta_gate(__s, this->M_len, gate_type::ROTATION_Y, _theta, q_target); });
         return *this;
     }
 
     qubit &qubit::apply_rotation_z(const double &_theta, const std::size_t &q_target)
     {
-        qubit::apply_theta_gate(this->M_qubits, this->M_len, gate_type::ROTATION_Z, _theta, q_target);
+        this->visit([&](const auto &__s)
+                    { qubit::apply_theta_gate(__s, this->M_len, gate_type::ROTATION_Z, _theta, q_target); });
         return *this;
     }
 
     qubit &qubit::apply_cnot(const std::size_t &q_control, const std::size_t &q_target)
     {
-        qubit::apply_2qubit_gate(this->M_qubits, this->M_len, gate_type::CONTROLLED_NOT, q_control, q_target);
+        this->visit([&](const auto &__s)
+                    { qubit::apply_2qubit_gate(__s, this->M_len, gate_type::CONTROLLED_NOT, q_control, q_target); });
         return *this;
     }
 
     qubit &qubit::apply_cz(const std::size_t &q_control, const std::size_t &q_target)
     {
-        qubit::apply_2qubit_gate(this->M_qubits, this->M_len, gate_type::CONTROLLED_Z, q_control, q_target);
+        this->visit([&](const auto &__s)
+                    { qubit::apply_2qubit_gate(__s, this->M_len, gate_type::CONTROLLED_Z, q_control, q_target); });
         return *this;
     }
 
     qubit &qubit::apply_swap(const std::size_t &qubit_1, const std::size_t &qubit_2)
     {
-        qubit::apply_2qubit_gate(this->M_qubits, this->M_len, gate_type::SWAP_GATE, qubit_1, qubit_2);
+        this->visit([&](const auto &__s)
+                    { qubit::apply_2qubit_gate(__s, this->M_len, gate_type::SWAP_GATE, qubit_1, qubit_2); });
+        return *this;
+    }
+
+    qubit &qubit::apply_mcx(const std::vector<std::size_t> &controls, const std::size_t &q_target)
+    {
+        this->visit([&](const auto &__s)
+                    { qubit::apply_controlled_gate(__s, this->M_len, this->M_no_qubits, controls, pre_defined_qgates[gate_type::PAULI_X].matrix, q_target); });
+        return *this;
+    }
+
+    qubit &qubit::apply_mcz(const std::vector<std::size_t> &controls, const std::size_t &q_target)
+    {
+        this->visit([&](const auto &__s)
+                    { qubit::apply_controlled_gate(__s, this->M_len, this->M_no_qubits, controls, pre_defined_qgates[gate_type::PAULI_Z].matrix, q_target); });
+        return *this;
+    }
+
+    qubit &qubit::apply_mcu(const std::vector<std::size_t> &controls, const complex (&__u)[2][2], const std::size_t &q_target)
+    {
+        this->visit([&](const auto &__s)
+                    { qubit::apply_controlled_gate(__s, this->M_len, this->M_no_qubits, controls, __u, q_target); });
         return *this;
     }
 
+    qubit &qubit::apply_matrix(const std::vector<std::size_t> &targets, const std::vector<complex> &matrix)
+    {
+        const std::size_t k = targets.size();
+        if (k == 0 || k > this->M_no_qubits || matrix.size() != (std::size_t(1) << (2 * k)))
+            fail<std::invalid_argument>("a matrix on %zu qubit(s) must have %zu entries, but it had %zu", k, k ? std::size_t(1) << (2 * k) : 0, matrix.size());
+        for (std::size_t i = 0; i < k; i++)
+        {
+            if (targets[i] >= this->M_no_qubits || std::count(targets.begin(), targets.end(), targets[i]) != 1)
+                fail<std::invalid_argument>("invalid or repeated target qubit %zu for a %zu qubit-system", targets[i], this->M_no_qubits);
+        }
+
+        this->visit([&](const auto &__s)
+                    { kernels::apply_matrix(__s, this->M_len, targets.data(), k, matrix.data()); });
+        return *this;
+    }
+
+    bool qubit::get_gate_matrix(complex (&__m)[2][2], const std::string &__gate, const double &__theta)
+    {
+        qgate_2x2 __g;
+        if (__gate == "I")
+            __g = pre_defined_qgates[gate_type::IDENTITY];
+        else if (__gate == "X")
+            __g = pre_defined_qgates[gate_type::PAULI_X];
+        else if (__gate == "Y")
+            __g = pre_defined_qgates[gate_type::PAULI_Y];
+        else if (__gate == "Z")
+            __g = pre_defined_qgates[gate_type::PAULI_Z];
+        else if (__gate == "H")
+            __g = pre_defined_qgates[gate_type::HADAMARD];
+        else if (__gate == "S")
+            __g = pre_defined_qgates[gate_type::PHASE_PI_2_SHIFT];
+        else if (__gate == "T")
+            __g = pre_defined_qgates[gate_type::PHASE_PI_4_SHIFT];
+        else if (__gate == "P")
+            qubit::get_theta_gate(__g, gate_type::PHASE_GENERAL_SHIFT, __theta);
+        else if (__gate == "Rx")
+            qubit::get_theta_gate(__g, gate_type::ROTATION_X, __theta);
+        else if (__gate == "Ry")
+            qubit::get_theta_gate(__g, gate_type::ROTATION_Y, __theta);
+        else if (__gate == "Rz")
+            qubit::get_theta_gate(__g, gate_type::ROTATION_Z, __theta);
+        else
+            return false;
+
+        for (std::size_t r = 0; r < 2; r++)
+            for (std::size_t c = 0; c < 2; c++)
+                __m[r][c] = __g.matrix[r][c];
+        return true;
+    }
+
+    std::size_t qubit::required_memory(const std::size_t &n, const state_precision &precision)
+    {
+        const std::size_t amplitude = precision == state_precision::FP32 ? sizeof(std::complex<float>) : sizeof(complex);
+        if (n >= static_cast<std::size_t>(std::numeric_limits<std::size_t>::digits) || (std::numeric_limits<std::size_t>::max() >> n) < amplitude)
+            return std::numeric_limits<std::size_t>::max();
+        return amplitude << n;
+    }
+
+    void qubit::set_memory_budget(const std::size_t &bytes)
+    {
+        qubit::M_memory_budget = bytes;
+    }
+
+    const std::size_t &qubit::get_memory_budget()
+    {
+        return qubit::M_memory_budget;
+    }
+
     const qubit::complex *qubit::get_qubits() const
     {
-        return this->M_qubits;
+        if (this->M_layout == state_layout::AOS && this->M_precision == state_precision::FP64)
+            return static_cast<const complex *>(this->M_data[0]);
+
+        this->M_view.resize(this->M_len);
+        this->visit([&](const auto &__s)
+                    {
+                        thread_pool::instance().parallel_for(0, this->M_len, 1, 1, [&](const std::size_t &b, const std::size_t &e)
+                                                             {
+                                                                 for (std::size_t i = b; i < e; i++)
+                                                                     this->M_view[i] = kernels::load(__s, i);
+                                                             });
+                    });
+        return this->M_view.data();
+    }
+
+    const state_layout &qubit::get_layout() const
+    {
+        return this->M_layout;
+    }
+
+    const state_precision &qubit::get_precision() const
+    {
+        return this->M_precision;
+    }
+
+    double qubit::total_probability() const
+    {
+        // per-block partial sums keep the result independent of the number of threads
+        constexpr std::size_t block = static_cast<std::size_t>(1) << 12;
+        std::vector<double> block_prob((this->M_len + block - 1) / block, 0.0);
+        this->visit([&](const auto &__s)
+                    {
+                        thread_pool::instance().parallel_for(0, this->M_len, block, 1, [&](const std::size_t &b, const std::size_t &e)
+                                                             {
+                                                                 for (std::size_t i = b; i < e; i += block)
+                                                                 {
+                                                                     double p = 0.0;
+                                                                     for (std::size_t j = i; j < std::min(e, i + block); j++)
+                                                                         p += std::norm(kernels::load(__s, j));
+                                                                     block_prob[i / block] = p;
+                                                                 }
+                                                             });
+                    });
+
+        double tot_prob = 0.0;
+        for (const double &p : block_prob)
+            tot_prob += p;
+        return tot_prob;
     }
 
     const std::size_t &qubit::get_size() const
@@ -279,7 +495,12 @@ namespace simulator
 
     const std::size_t qubit::memory_consumption() const
     {
-        return sizeof(complex) * (this->M_len);
+        return (this->M_precision == state_precision::FP32 ? sizeof(std::complex<float>) : sizeof(complex)) * this->M_len;
+    }
+
+    const char *qubit::allocation_policy() const
+    {
+        return this->M_policy;
     }
 
     const std::size_t &qubit::no_of_qubits() const
@@ -289,14 +510,19 @@ namespace simulator
 
     void qubit::get_nth_qubit(complex (&__s)[2], const std::size_t &nth) const
     {
-        std::size_t mask = 1 << (this->M_no_qubits - nth - 1);
-        for (std::size_t i = 0; i < this->M_len; i++)
-        {
-            if (i & mask)
-                __s[1] += this->M_qubits[i];
-            else
-                __s[0] += this->M_qubits[i];
-        }
+        if (nth >= this->M_no_qubits)
+            fail<std::out_of_range>("qubit %zu does not exist in a %zu qubit-system", nth, this->M_no_qubits);
+        std::size_t mask = std::size_t(1) << (this->M_no_qubits - nth - 1);
+        this->visit([&](const auto &st)
+                    {
+                        for (std::size_t i = 0; i < this->M_len; i++)
+                        {
+                            if (i & mask)
+                                __s[1] += kernels::load(st, i);
+                            else
+                                __s[0] += kernels::load(st, i);
+                        }
+                    });
         double norm = std::sqrt((std::abs(__s[0]) * std::abs(__s[0])) + (std::abs(__s[1]) * std::abs(__s[1])));
 
         if (norm > 0)
@@ -310,59 +536,326 @@ namespace simulator
     {
         if (!probs)
             return probs;
-        for (std::size_t i = 0; i < this->M_len; i++)
-        {
-            probs[i] = std::norm(this->M_qubits[i]);
-        }
+        this->visit([&](const auto &__s)
+                    {
+                        thread_pool::instance().parallel_for(0, this->M_len, 1, 1, [&](const std::size_t &b, const std::size_t &e)
+                                                             {
+                                                                 for (std::size_t i = b; i < e; i++)
+                                                                 {
+                                                                     probs[i] = std::norm(kernels::load(__s, i));
+                                                                 }
+                                                             });
+                    });
         return probs;
     }
 
-    std::size_t qubit::measure()
+    // amplitudes per partial sum of the measurement and sampling reductions, fixed so that the sums (and the seeded draws) do not depend on the thread count
+    static constexpr std::size_t prob_block = static_cast<std::size_t>(1) << 12;
+
+    double qubit::block_probabilities(std::vector<double> &block_prob) const
     {
+        block_prob.assign((this->M_len + prob_block - 1) / prob_block, 0.0);
+        this->visit([&](const auto &__s)
+                    {
+                        thread_pool::instance().parallel_for(0, this->M_len, prob_block, 1, [&](const std::size_t &b, const std::size_t &e)
+                                                             {
+                                                                 for (std::size_t i = b; i < e; i += prob_block)
+                                                                 {
+                                                                     double p = 0.0;
+                                                                     for (std::size_t j = i; j < std::min(e, i + prob_block); j++)
+                                                                         p += std::norm(kernels::load(__s, j));
+                                                                     block_prob[i / prob_block] = p;
+                                                                 }
+                                                             });
+                    });
+
         double tot_prob = 0.0;
-        for (std::size_t i = 0; i < this->M_len; i++)
+        for (const double &p : block_prob)
+            tot_prob += p;
+        return tot_prob;
+    }
+
+    std::size_t qubit::draw_basis_state()
+    {
+        // per-block totals, computed in parallel, let the cumulative scan skip straight to the block holding the outcome
+        std::vector<double> block_prob;
+        const double tot_prob = this->block_probabilities(block_prob);
+        double r = this->M_rng.uniform() * tot_prob;
+
+        double accum = 0.0;
+        std::size_t res = 0, blk = 0;
+        for (; blk + 1 < block_prob.size() && accum + block_prob[blk] < r; blk++)
+            accum += block_prob[blk];
+        this->visit([&](const auto &__s)
+                    {
+                        // zero amplitudes are never drawn, r == 0 must not land on one
+                        for (std::size_t i = blk * prob_block; i < std::min(this->M_len, (blk + 1) * prob_block); i++)
+                        {
+                            const double w = std::norm(kernels::load(__s, i));
+                            if (w <= 0.0)
+                                continue;
+                            accum += w;
+                            res = i;
+                            if (accum >= r)
+                                break;
+                        } });
+        return res;
+    }
+
+    std::size_t qubit::measure()
+    {
+        const std::size_t res = this->draw_basis_state();
+        this->visit([&](const auto &__s)
+                    {
+                        thread_pool::instance().parallel_for(0, this->M_len, 1, 1, [&](const std::size_t &b, const std::size_t &e)
+                                                             {
+                                                                 for (std::size_t i = b; i < e; i++)
+                                                                 {
+                                                                     kernels::store(__s, i, (i == res) ? (complex){1.0, 0.0} : (complex){0.0, 0.0});
+                                                                 }
+                                                             });
+                    });
+
+        return res;
+    }
+
+    std::size_t qubit::measure_qubits(const std::vector<std::size_t> &targets)
+    {
+        // a single target takes the two passes of measure_nth_qubit
+        if (targets.size() == 1)
+            return this->measure_nth_qubit(targets.front()) << targets.front();
+
+        std::size_t mask = 0;
+        for (const std::size_t &t : targets)
         {
-            tot_prob += std::norm(this->M_qubits[i]);
+            check_qubit(t, this->M_len);
+            mask |= std::size_t(1) << t;
         }
 
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_real_distribution dist(0.0, tot_prob);
-        double r = dist(gen);
+        // one basis state drawn from the whole distribution carries the joint outcome of the targets in its bits
+        const std::size_t outcome = this->draw_basis_state() & mask;
 
-        double accum = 0.0;
-        std::size_t res = 0;
-        for (std::size_t i = 0; i < this->M_len; i++)
+        // the amplitudes of the other outcomes are zeroed while the kept probability is summed, then the kept ones are renormalized
+        std::vector<double> block_prob((this->M_len + prob_block - 1) / prob_block, 0.0);
+        thread_pool &pool = thread_pool::instance();
+        this->visit([&](const auto &__s)
+                    {
+                        pool.parallel_for(0, this->M_len, prob_block, 1, [&](const std::size_t &b, const std::size_t &e)
+                                          {
+                                              for (std::size_t i = b; i < e; i += prob_block)
+                                              {
+                                                  double p = 0.0;
+                                                  for (std::size_t j = i; j < std::min(e, i + prob_block); j++)
+                                                  {
+                                                      if ((j & mask) == outcome)
+                                                          p += std::norm(kernels::load(__s, j));
+                                                      else
+                                                          kernels::store(__s, j, 0);
+                                                  }
+                                                  block_prob[i / prob_block] = p;
+                                              }
+                                          });
+                    });
+        double kept = 0.0;
+        for (const double &p : block_prob)
+            kept += p;
+
+        const double scale = 1.0 / std::sqrt(kept);
+        this->visit([&](const auto &__s)
+                    {
+                        pool.parallel_for(0, this->M_len, 1, 1, [&](const std::size_t &b, const std::size_t &e)
+                                          {
+                                              for (std::size_t i = b; i < e; i++)
+                                                  if ((i & mask) == outcome)
+                                                      kernels::store(__s, i, kernels::load(__s, i) * scale);
+                                          });
+                    });
+        return outcome;
+    }
+
+    // splits `shots` among weights[0..len) (summing to `total`) as a multinomial draw, one conditional binomial per weight
+    // calls fn(i, count) for every i with count > 0, in ascending order; the last non-zero weight takes what rounding leaves over
+    template <typename W, typename Fn>
+    static void split_shots(const std::size_t &shots, const std::size_t &len, const double &total, W &&weight, rng &gen, Fn &&fn)
+    {
+        std::size_t last = len;
+        while (last > 0 && weight(last - 1) <= 0.0)
+            last--;
+        double rest = total;
+        std::size_t left = shots;
+        for (std::size_t i = 0; i < last && left > 0; i++)
         {
-            accum += std::norm(this->M_qubits[i]);
-            if (accum >= r)
-            {
-                res = i;
-                break;
-            }
+            const double w = weight(i);
+            std::size_t c = left;
+            if (w <= 0.0)
+                c = 0;
+            else if (i + 1 < last && w < rest)
+                c = std::binomial_distribution<std::size_t>(left, w / rest)(gen);
+            rest -= w;
+            left -= c;
+            if (c > 0)
+                fn(i, c);
         }
+    }
+
+    qubit::histogram qubit::sample(const std::size_t &shots)
+    {
+        thread_pool &pool = thread_pool::instance();
+        constexpr std::size_t block = prob_block;
+        std::vector<double> block_prob;
+        const double tot_prob = this->block_probabilities(block_prob);
 
-        for (std::size_t i = 0; i < this->M_len; i++)
+        // shots per block first, then every block is sampled on its own stream of a key drawn from M_rng
+        // the blocks, not the threads, own the streams, so the counts only depend on the seed
+        std::vector<std::size_t> block_shots(block_prob.size(), 0);
+        split_shots(shots, block_prob.size(), tot_prob, [&](const std::size_t &b)
+                    { return block_prob[b]; }, this->M_rng, [&](const std::size_t &b, const std::size_t &c)
+                    { block_shots[b] = c; });
+        const std::uint64_t key = this->M_rng();
+
+        std::vector<histogram> parts(block_prob.size());
+        this->visit([&](const auto &__s)
+                    {
+                        pool.parallel_for(0, this->M_len, block, 1, [&](const std::size_t &b, const std::size_t &e)
+                                          {
+                                              for (std::size_t i = b; i < e; i += block)
+                                              {
+                                                  const std::size_t blk = i / block, len = std::min(e, i + block) - i, c = block_shots[blk];
+                                                  if (c == 0)
+                                                      continue;
+                                                  rng g(key, blk);
+                                                  histogram &out = parts[blk];
+                                                  auto weight = [&](const std::size_t &j)
+                                                  { return std::norm(kernels::load(__s, i + j)); };
+
+                                                  // more shots than amplitudes: a binomial per amplitude, otherwise the shots' sorted uniforms are merged with the cumulative sum
+                                                  if (c > len)
+                                                  {
+                                                      split_shots(c, len, block_prob[blk], weight, g, [&](const std::size_t &j, const std::size_t &n)
+                                                                  { out.emplace_back(i + j, n); });
+                                                      continue;
+                                                  }
+                                                  // partial sums of c + 1 exponential variates, scaled by the last one, are c sorted uniforms: no sort needed
+                                                  std::vector<double> u(c);
+                                                  std::exponential_distribution<double> dist(1.0);
+                                                  double sum = 0.0;
+                                                  for (double &x : u)
+                                                      x = sum += dist(g);
+                                                  const double scale = block_prob[blk] / (sum + dist(g));
+                                                  for (double &x : u)
+                                                      x *= scale;
+                                                  double accum = 0.0;
+                                                  std::size_t k = 0, last = 0;
+                                                  for (std::size_t j = 0; j < len && k < c; j++)
+                                                  {
+                                                      const double w = weight(j);
+                                                      if (w <= 0.0)
+                                                          continue;
+                                                      accum += w;
+                                                      last = j;
+                                                      const std::size_t from = k;
+                                                      while (k < c && u[k] < accum)
+                                                          k++;
+                                                      if (k > from)
+                                                          out.emplace_back(i + j, k - from);
+                                                  }
+                                                  // uniforms beyond the rounded cumulative sum belong to the last non-zero amplitude
+                                                  if (k < c)
+                                                  {
+                                                      if (!out.empty() && out.back().first == i + last)
+                                                          out.back().second += c - k;
+                                                      else
+                                                          out.emplace_back(i + last, c - k);
+                                                  }
+                                              }
+                                          });
+                    });
+
+        histogram counts;
+        for (const histogram &h : parts)
+            counts.insert(counts.end(), h.begin(), h.end());
+        return counts;
+    }
+
+    qubit::histogram qubit::sample(const std::size_t &shots, const std::vector<std::size_t> &targets)
+    {
+        std::vector<std::size_t> qubits(targets);
+        std::sort(qubits.begin(), qubits.end());
+        qubits.erase(std::unique(qubits.begin(), qubits.end()), qubits.end());
+        std::size_t mask = 0;
+        for (const std::size_t &t : qubits)
         {
-            this->M_qubits[i] = (i == res) ? (complex){1.0, 0.0} : (complex){0.0, 0.0};
+            check_qubit(t, this->M_len);
+            mask |= std::size_t(1) << t;
         }
 
-        return res;
+        // too many outcomes for a marginal table: the whole system is sampled and the other qubits are masked out of the counts
+        histogram counts;
+        const std::size_t m = qubits.size();
+        if (m > 12)
+        {
+            counts = this->sample(shots);
+            for (auto &[i, c] : counts)
+                i &= mask;
+            std::sort(counts.begin(), counts.end());
+            std::size_t n = 0;
+            for (std::size_t k = 0; k < counts.size(); k++)
+            {
+                if (n > 0 && counts[n - 1].first == counts[k].first)
+                    counts[n - 1].second += counts[k].second;
+                else
+                    counts[n++] = counts[k];
+            }
+            counts.resize(n);
+            return counts;
+        }
+
+        // marginal distribution of the 2^m joint outcomes (bit b of an outcome is qubit qubits[b]), summed over at most 64 fixed spans of the state-vector
+        // the spans are added in order, so that the table does not depend on the thread count
+        const std::size_t outcomes = std::size_t(1) << m;
+        const std::size_t blocks = (this->M_len + prob_block - 1) / prob_block;
+        const std::size_t span = (blocks + 63) / 64 * prob_block;
+        std::vector<double> partial((this->M_len + span - 1) / span * outcomes, 0.0);
+        this->visit([&](const auto &__s)
+                    {
+                        thread_pool::instance().parallel_for(0, this->M_len, span, 1, [&](const std::size_t &b, const std::size_t &e)
+                                                             {
+                                                                 for (std::size_t i = b; i < e; i += span)
+                                                                 {
+                                                                     double *acc = partial.data() + i / span * outcomes;
+                                                                     for (std::size_t j = i; j < std::min(e, i + span); j++)
+                                                                     {
+                                                                         std::size_t k = 0;
+                                                                         for (std::size_t q = 0; q < m; q++)
+                                                                             k |= ((j >> qubits[q]) & 1) << q;
+                                                                         acc[k] += std::norm(kernels::load(__s, j));
+                                                                     }
+                                                                 }
+                                                             });
+                    });
+        std::vector<double> marginal(outcomes, 0.0);
+        for (std::size_t p = 0; p < partial.size(); p++)
+            marginal[p % outcomes] += partial[p];
+        double tot_prob = 0.0;
+        for (const double &p : marginal)
+            tot_prob += p;
+
+        split_shots(shots, outcomes, tot_prob, [&](const std::size_t &k)
+                    { return marginal[k]; }, this->M_rng, [&](const std::size_t &k, const std::size_t &c)
+                    {
+                        std::size_t i = 0;
+                        for (std::size_t q = 0; q < m; q++)
+                            i |= ((k >> q) & 1) << qubits[q];
+                        counts.emplace_back(i, c); });
+        return counts;
     }
 
     std::size_t qubit::measure_nth_qubit(const std::size_t &nth)
     {
+        check_qubit(nth, this->M_len);
         double prob0 = 0.0, prob1 = 0.0;
-
-        for (int i = 0; i < this->M_len; i++)
-        {
-            int bit = (i >> nth) & 1;
-            double ampSquared = std::norm(this->M_qubits[i]); // norm = |amplitude|^2
-            if (bit == 0)
-                prob0 += ampSquared;
-            else
-                prob1 += ampSquared;
-        }
+        this->visit([&](const auto &__s)
+                    { kernels::qubit_probabilities(__s, this->M_len, nth, prob0, prob1); });
 
         double totalProb = prob0 + prob1;
         if (std::abs(totalProb - 1.0) > 1.0E-6)
@@ -371,12 +864,9 @@ namespace simulator
         }
 
         // Randomly choose measurement outcome based on the computed probabilities.
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_real_distribution<> dis(0.0, 1.0);
-        double rnd = dis(gen);
+        double rnd = this->M_rng.uniform();
 
-        int outcome = (rnd < prob0) ? 0 : 1;
+        std::size_t outcome = (rnd < prob0) ? 0 : 1;
 
         // Collapse the state vector: set amplitudes incompatible with the outcome to zero.
         double normFactor = (outcome == 0) ? std::sqrt(prob0) : std::sqrt(prob1);
@@ -386,37 +876,71 @@ namespace simulator
             return -1;
         }
 
-        for (int i = 0; i < this->M_len; i++)
+        this->visit([&](const auto &__s)
+                    { kernels::collapse_qubit(__s, this->M_len, nth, outcome, 1.0 / normFactor); });
+
+        return outcome;
+    }
+
+    void qubit::seed(const std::uint64_t &s)
+    {
+        this->M_rng = rng(s);
+    }
+
+    bool qubit::remove_qubit(const std::size_t &nth, const std::size_t &outcome)
+    {
+        check_qubit(nth, this->M_len);
+        if (this->M_no_qubits < 2)
         {
-            int bit = (i >> nth) & 1;
-            if (bit != outcome)
-            {
-                this->M_qubits[i] = 0;
-            }
-            else
-            {
-                this->M_qubits[i] /= normFactor; // renormalize amplitude
-            }
+            std::fprintf(stderr, "error: the last qubit of a system cannot be removed.\n");
+            return false;
         }
+        this->visit([&](const auto &__s)
+                    { kernels::compact_qubit(__s, this->M_len, nth, outcome & 1); });
 
-        return outcome;
+        const std::size_t bytes = buffer_size(this->M_len, this->M_layout, this->M_precision) / 2;
+        for (void *buf : this->M_data)
+            if (buf)
+                this->M_alloc->discard(static_cast<unsigned char *>(buf) + bytes, bytes);
+        this->M_len /= 2;
+        this->M_no_qubits--;
+        // the complex<double> copy of the larger state-vector is as large as the memory given back
+        this->M_view.clear();
+        this->M_view.shrink_to_fit();
+        return true;
+    }
+
+    bool qubit::insert_qubit(const std::size_t &nth, const std::size_t &value)
+    {
+        if (nth > this->M_no_qubits || 2 * this->M_len > this->M_capacity)
+        {
+            std::fprintf(stderr, "error: cannot insert qubit %zu in a %zu qubit-system allocated for %zu amplitudes.\n", nth, this->M_no_qubits, this->M_capacity);
+            return false;
+        }
+        this->M_len *= 2;
+        this->M_no_qubits++;
+        this->visit([&](const auto &__s)
+                    { kernels::expand_qubit(__s, this->M_len, nth, value & 1); });
+        return true;
     }
 
     qubit &qubit::operator=(const qubit &q)
     {
         if (this != &q)
         {
-            if (this->M_qubits)
-                delete[] this->M_qubits;
+            this->release();
 
             this->M_len = q.M_len;
             this->M_no_qubits = q.M_no_qubits;
-            this->M_qubits = new complex[this->M_len]();
-
-            for (std::size_t i = 0; i < this->M_len; i++)
-            {
-                this->M_qubits[i] = q.M_qubits[i];
-            }
+            this->M_layout = q.M_layout;
+            this->M_precision = q.M_precision;
+            this->M_alloc = q.M_alloc;
+            this->M_rng = q.M_rng;
+            this->allocate();
+
+            for (std::size_t b = 0; b < 2; b++)
+                if (this->M_data[b])
+                    std::memcpy(this->M_data[b], q.M_data[b], buffer_size(this->M_len, this->M_layout, this->M_precision));
         }
         return *this;
     }
@@ -425,22 +949,27 @@ namespace simulator
     {
         if (this != &q)
         {
-            if (this->M_qubits)
-                delete[] this->M_qubits;
+            this->release();
 
             this->M_len = q.M_len;
             this->M_no_qubits = q.M_no_qubits;
-            this->M_qubits = q.M_qubits;
-
-            q.M_len = q.M_no_qubits = 0;
-            q.M_qubits = nullptr;
+            this->M_layout = q.M_layout;
+            this->M_precision = q.M_precision;
+            this->M_alloc = q.M_alloc;
+            this->M_policy = q.M_policy;
+            this->M_rng = q.M_rng;
+            this->M_capacity = q.M_capacity;
+            this->M_data[0] = q.M_data[0];
+            this->M_data[1] = q.M_data[1];
+
+            q.M_len = q.M_no_qubits = q.M_capacity = 0;
+            q.M_data[0] = q.M_data[1] = nullptr;
         }
         return *this;
     }
 
     qubit::~qubit()
     {
-        if (this->M_qubits)
-            delete[] this->M_qubits;
+        this->release();
     }
-}
\ No newline at end of file
+}
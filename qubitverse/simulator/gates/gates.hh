@@ -10,13 +10,34 @@
 #include <complex>
 #include <random>
 #include <cmath> // for sqrt and M_PI
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <utility>
+#include "./allocator.hh"
+#include "./rng.hh"
 
 namespace simulator
 {
+    // memory layout of the state-vector, the gate kernels are compiled for both
+    enum state_layout : unsigned char
+    {
+        AOS, // array of std::complex<double>, real and imaginary parts interleaved
+        SOA  // separate 64-byte aligned arrays for the real and the imaginary parts
+    };
+
+    // precision of the amplitudes, FP32 halves the memory and the bandwidth of every gate for about 7 significant digits
+    enum state_precision : unsigned char
+    {
+        FP64, // std::complex<double>
+        FP32  // std::complex<float>
+    };
+
     class qubit
     {
       public:
         using complex = std::complex<double>;
+        using histogram = std::vector<std::pair<std::size_t, std::size_t>>; // (basis state, count), ascending basis states
 
       private:
         enum gate_type : unsigned char
@@ -53,21 +74,46 @@ namespace simulator
             {PHASE_PI_4_SHIFT, {{1, 0}, {0, {M_SQRT1_2, M_SQRT1_2}}}} // e^(i * pi/4) = (sqrt(2)/2) + i(sqrt(2)/2)
         };
 
-        static void apply_predefined_gate(complex *&__s, const std::size_t &_len, const gate_type &__g_type, const std::size_t &qubit_target);
+        static bool is_diagonal(const gate_type &__g_type);
+        template <typename S>
+        static void apply_predefined_gate(const S &__s, const std::size_t &_len, const gate_type &__g_type, const std::size_t &qubit_target);
         static qgate_2x2 &get_theta_gate(qgate_2x2 &__g, const gate_type &__g_type, const double &__theta);
-        static void apply_theta_gate(complex *&__s, const std::size_t &_len, const gate_type &__g_type, const double &__theta, const std::size_t &qubit_target);
-        static void apply_2qubit_gate(complex *&__s, const std::size_t &_len, const gate_type &__g_type, const std::size_t &q_control, const std::size_t &q_target);
+        template <typename S>
+        static void apply_theta_gate(const S &__s, const std::size_t &_len, const gate_type &__g_type, const double &__theta, const std::size_t &qubit_target);
+        template <typename S>
+        static void apply_controlled_gate(const S &__s, const std::size_t &_len, const std::size_t &n, const std::vector<std::size_t> &controls, const complex (&__m)[2][2], const std::size_t &q_target);
+        template <typename S>
+        static void apply_2qubit_gate(const S &__s, const std::size_t &_len, const gate_type &__g_type, const std::size_t &q_control, const std::size_t &q_target);
+
+        static std::size_t M_memory_budget; // largest state-vector, in bytes, that the constructor accepts
+
+        // calls fn with a kernels::aos_state<T> or a kernels::soa_state<T> view of the state-vector, depending on M_layout and M_precision
+        template <typename Fn>
+        void visit(Fn &&fn) const;
+        void allocate();
+        void release();
+        // |amplitude|^2 summed per fixed block of amplitudes, returns the total
+        double block_probabilities(std::vector<double> &block_prob) const;
+        // a basis state drawn from the distribution of the state-vector, which is left untouched
+        std::size_t draw_basis_state();
 
         // a vector-space (hilbert-space) defined over complex numbers C
         // 1 << M_no_qubits translates to 2^N, where N is the number of qubit the hilbert-space(quantum-system) supports
-        // memory consumption on x86_64 architecture for N-qubit system is: f(N) = 16 * 2^abs(N) bytes, that is exponential growth
+        // memory consumption on x86_64 architecture for N-qubit system is: f(N) = 16 * 2^abs(N) bytes (8 * 2^abs(N) bytes in FP32), that is exponential growth
         // Initially, the hilbert-space is defined as 1 + 0i, 0 + 0i, 0 + 0i, 0 + 0i, 0 + 0i, ..., 0 + 0i
-        complex *M_qubits;
+        state_layout M_layout;
+        state_precision M_precision;
+        state_allocator *M_alloc;            // source of M_data, the default allocator at construction, inherited by copies
+        const char *M_policy;                // how M_data was actually obtained, reported by allocation_policy()
+        void *M_data[2];                     // AOS: the interleaved amplitudes in M_data[0], SOA: the real parts in M_data[0] and the imaginary parts in M_data[1]
+        mutable std::vector<complex> M_view; // complex<double> copy handed out by get_qubits() for every storage but AOS in FP64
         std::size_t M_len, M_no_qubits;
+        std::size_t M_capacity;        // amplitudes the buffers were allocated for, above M_len once remove_qubit has shrunk the state-vector
+        rng M_rng{rng::random_seed()}; // draws every measurement and sample, a copy continues the same sequence
 
       public:
         qubit() = delete;
-        qubit(const std::size_t &n);
+        qubit(const std::size_t &n, const state_layout &layout = state_layout::AOS, const state_precision &precision = state_precision::FP64);
         qubit(const qubit &q);
         qubit(qubit &&q) noexcept(true);
         qubit &apply_identity(const std::size_t &q_target);
@@ -84,14 +130,44 @@ namespace simulator
         qubit &apply_cnot(const std::size_t &q_control, const std::size_t &q_target);
         qubit &apply_cz(const std::size_t &q_control, const std::size_t &q_target);
         qubit &apply_swap(const std::size_t &qubit_1, const std::size_t &qubit_2);
-        const complex *get_qubits() const;
+        qubit &apply_mcx(const std::vector<std::size_t> &controls, const std::size_t &q_target);
+        qubit &apply_mcz(const std::vector<std::size_t> &controls, const std::size_t &q_target);
+        qubit &apply_mcu(const std::vector<std::size_t> &controls, const complex (&__u)[2][2], const std::size_t &q_target);
+        qubit &apply_matrix(const std::vector<std::size_t> &targets, const std::vector<complex> &matrix);
+        static bool get_gate_matrix(complex (&__m)[2][2], const std::string &__gate, const double &__theta);
+        // bytes of an n qubit state-vector, SIZE_MAX when it does not even fit in the address space
+        static std::size_t required_memory(const std::size_t &n, const state_precision &precision = state_precision::FP64);
+        // defaults to QUBITVERSE_MEMORY_BUDGET_MB, or to the physical memory of the machine
+        static void set_memory_budget(const std::size_t &bytes);
+        static const std::size_t &get_memory_budget();
+        const complex *get_qubits() const; // for the SOA layout or FP32 this converts the state-vector into an interleaved complex<double> copy
+        const state_layout &get_layout() const;
+        const state_precision &get_precision() const;
+        double total_probability() const; // sum of |amplitude|^2, drifts away from 1 by the rounding errors of every gate
         const std::size_t &get_size() const;
         const std::size_t memory_consumption() const;
+        const char *allocation_policy() const; // "hugetlb", "transparent-hugepages", "mmap" or "aligned"
         const std::size_t &no_of_qubits() const;
         void get_nth_qubit(complex (&__s)[2], const std::size_t &nth) const;
         double *&compute_probabilities(double *&probs) const;
         std::size_t measure();
+        // counts of `shots` independent measurements of the whole system, the state-vector is left untouched
+        histogram sample(const std::size_t &shots);
+        // counts of `shots` joint measurements of `targets` only, drawn from their marginal distribution
+        // keyed by the basis state with every other qubit 0, the state-vector is left untouched
+        histogram sample(const std::size_t &shots, const std::vector<std::size_t> &targets);
+        // restarts the random sequence of measure(), measure_nth_qubit() and sample(), the same seed and circuit give the same outcomes
+        void seed(const std::uint64_t &s);
         std::size_t measure_nth_qubit(const std::size_t &nth);
+        // measures all the `targets` at once, as measure_nth_qubit on each of them but in at most three passes over the state-vector whatever their number
+        // returns the basis state restricted to the targets (every other qubit 0)
+        std::size_t measure_qubits(const std::vector<std::size_t> &targets);
+        // projects `nth` out of the system, it has to be in the basis state `outcome` as measure_nth_qubit leaves it: the state-vector shrinks in place to 2^(n-1) amplitudes
+        // and the qubits above `nth` move down by one, the memory of the upper half goes back to the system when the allocator allows it (see state_allocator::discard); false for the last qubit of the system
+        bool remove_qubit(const std::size_t &nth, const std::size_t &outcome);
+        // the inverse of remove_qubit: a new qubit in the basis state `value` takes the position `nth` and the qubits from `nth` up move up by one
+        // the state-vector grows in place, so it can only take back the qubits removed from it; false beyond that
+        bool insert_qubit(const std::size_t &nth, const std::size_t &value);
         qubit &operator=(const qubit &q);
         qubit &operator=(qubit &&q) noexcept(true);
         ~qubit();
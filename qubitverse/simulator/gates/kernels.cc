@@ -0,0 +1,1176 @@
+/**
+ * @file kernels.cc
+ * @license This file is licensed under the GNU GENERAL PUBLIC LICENSE Version 3, 29 June 2007. You may obtain a copy of this license at https://www.gnu.org/licenses/gpl-3.0.en.html.
+ * @author Tushar Chaurasia (Dark-CodeX)
+ */
+
+#include "./kernels.hh"
+#include "./thread_pool.hh"
+#include <algorithm>
+#include <vector>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// every ISA level is compiled into the same binary through function-level target attributes, the one to run is picked once at runtime
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMULATOR_KERNELS_X86
+#include <immintrin.h>
+#define SIMULATOR_TARGET_SSE42 __attribute__((target("sse4.2")))
+#define SIMULATOR_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define SIMULATOR_TARGET_AVX512 __attribute__((target("avx512f,avx2,fma")))
+#endif
+
+// forces a generic kernel body into each of its per-ISA wrappers, so that every copy is vectorized for the wrapper's target
+#if defined(__GNUC__)
+#define SIMULATOR_ALWAYS_INLINE __attribute__((always_inline))
+#else
+#define SIMULATOR_ALWAYS_INLINE
+#endif
+
+namespace simulator::kernels
+{
+    // walks the pair indices [kb, ke) of a gate acting on the bit `stride`, pair k maps to the amplitudes i0 and i0 + stride where i0 is k with a 0 inserted at the target bit
+    // fn(i0, run) receives the runs of consecutive pairs that share a block of 2 * stride amplitudes
+    template <typename Fn>
+    static inline void for_each_run(const std::size_t &kb, const std::size_t &ke, const std::size_t &stride, Fn &&fn)
+    {
+        for (std::size_t k = kb; k < ke;)
+        {
+            const std::size_t j = k & (stride - 1);
+            const std::size_t run = std::min(ke - k, stride - j);
+            fn(((k - j) << 1) | j, run);
+            k += run;
+        }
+    }
+
+    // inserts a 0 at every bit position of `bits` (sorted ascending) into k
+    static inline std::size_t insert_zero_bits(std::size_t k, const std::size_t *bits, const std::size_t &nbits)
+    {
+        for (std::size_t b = 0; b < nbits; b++)
+        {
+            const std::size_t low = (std::size_t(1) << bits[b]) - 1;
+            k = ((k & ~low) << 1) | (k & low);
+        }
+        return k;
+    }
+
+    // same as for_each_run, but for the sub-space indices [kb, ke) left after removing the bits `bits` (sorted ascending) from the index
+    // fn(i0, run) receives runs of consecutive indices whose removed bits are all 0
+    template <typename Fn>
+    static inline void for_each_subspace_run(const std::size_t &kb, const std::size_t &ke, const std::size_t *bits, const std::size_t &nbits, Fn &&fn)
+    {
+        const std::size_t stride = std::size_t(1) << bits[0];
+        for (std::size_t k = kb; k < ke;)
+        {
+            const std::size_t run = std::min(ke - k, stride - (k & (stride - 1)));
+            fn(insert_zero_bits(k, bits, nbits), run);
+            k += run;
+        }
+    }
+
+    // the 2x2 matrix as m00r, m00i, m01r, m01i, m10r, m10i, m11r, m11i, rounded to the precision of the state-vector
+    template <typename T>
+    static inline void unpack_2x2(const complex (&__m)[2][2], T (&m)[8])
+    {
+        for (std::size_t r = 0; r < 2; r++)
+        {
+            for (std::size_t c = 0; c < 2; c++)
+            {
+                m[4 * r + 2 * c] = static_cast<T>(__m[r][c].real());
+                m[4 * r + 2 * c + 1] = static_cast<T>(__m[r][c].imag());
+            }
+        }
+    }
+
+    // out0 = m00 * a + m01 * b, out1 = m10 * a + m11 * b on n interleaved pairs (p0[2t], p0[2t + 1]), (p1[2t], p1[2t + 1]), written on the real and imaginary parts
+    template <typename T>
+    SIMULATOR_ALWAYS_INLINE static inline void mul_2x2_aos(T *p0, T *p1, const std::size_t &n, const T (&m)[8])
+    {
+        for (std::size_t j = 0; j < 2 * n; j += 2)
+        {
+            const T ar = p0[j], ai = p0[j + 1], br = p1[j], bi = p1[j + 1];
+            p0[j] = m[0] * ar - m[1] * ai + m[2] * br - m[3] * bi;
+            p0[j + 1] = m[0] * ai + m[1] * ar + m[2] * bi + m[3] * br;
+            p1[j] = m[4] * ar - m[5] * ai + m[6] * br - m[7] * bi;
+            p1[j + 1] = m[4] * ai + m[5] * ar + m[6] * bi + m[7] * br;
+        }
+    }
+
+    // same on n split pairs (a_re[t], a_im[t]), (b_re[t], b_im[t])
+    template <typename T>
+    SIMULATOR_ALWAYS_INLINE static inline void mul_2x2_soa(T *a_re, T *a_im, T *b_re, T *b_im, const std::size_t &n, const T (&m)[8])
+    {
+        for (std::size_t t = 0; t < n; t++)
+        {
+            const T ar = a_re[t], ai = a_im[t], br = b_re[t], bi = b_im[t];
+            a_re[t] = m[0] * ar - m[1] * ai + m[2] * br - m[3] * bi;
+            a_im[t] = m[0] * ai + m[1] * ar + m[2] * bi + m[3] * br;
+            b_re[t] = m[4] * ar - m[5] * ai + m[6] * br - m[7] * bi;
+            b_im[t] = m[4] * ai + m[5] * ar + m[6] * bi + m[7] * br;
+        }
+    }
+
+    // multiplies the n consecutive amplitudes starting at i by z, written on the real and imaginary parts so that it vectorizes without the inf/nan handling of std::complex
+    template <typename T>
+    static inline void scale_run(const aos_state<T> &__s, const std::size_t &i, const std::size_t &n, const complex &z)
+    {
+        T *p = reinterpret_cast<T *>(__s.M_data + i);
+        if (z == complex(-1.0, 0.0))
+        {
+            for (std::size_t j = 0; j < 2 * n; j++)
+                p[j] = -p[j];
+            return;
+        }
+        if (z.imag() == 0.0)
+        {
+            const T zr = static_cast<T>(z.real());
+            for (std::size_t j = 0; j < 2 * n; j++)
+                p[j] *= zr;
+            return;
+        }
+
+        const T zr = static_cast<T>(z.real()), zi = static_cast<T>(z.imag());
+        for (std::size_t j = 0; j < 2 * n; j += 2)
+        {
+            const T re = p[j], im = p[j + 1];
+            p[j] = zr * re - zi * im;
+            p[j + 1] = zr * im + zi * re;
+        }
+    }
+
+    template <typename T>
+    static inline void scale_run(const soa_state<T> &__s, const std::size_t &i, const std::size_t &n, const complex &z)
+    {
+        T *re = __s.M_re + i, *im = __s.M_im + i;
+        if (z == complex(-1.0, 0.0))
+        {
+            for (std::size_t j = 0; j < n; j++)
+                re[j] = -re[j];
+            for (std::size_t j = 0; j < n; j++)
+                im[j] = -im[j];
+            return;
+        }
+        if (z.imag() == 0.0)
+        {
+            const T zr = static_cast<T>(z.real());
+            for (std::size_t j = 0; j < n; j++)
+                re[j] *= zr;
+            for (std::size_t j = 0; j < n; j++)
+                im[j] *= zr;
+            return;
+        }
+
+        const T zr = static_cast<T>(z.real()), zi = static_cast<T>(z.imag());
+        for (std::size_t j = 0; j < n; j++)
+        {
+            const T r = re[j], m = im[j];
+            re[j] = zr * r - zi * m;
+            im[j] = zr * m + zi * r;
+        }
+    }
+
+    // sets the n consecutive amplitudes starting at i to 0, all-zero bytes are +0.0
+    template <typename T>
+    static inline void zero_run(const aos_state<T> &__s, const std::size_t &i, const std::size_t &n)
+    {
+        std::memset(static_cast<void *>(__s.M_data + i), 0, n * sizeof(std::complex<T>));
+    }
+
+    template <typename T>
+    static inline void zero_run(const soa_state<T> &__s, const std::size_t &i, const std::size_t &n)
+    {
+        std::memset(__s.M_re + i, 0, n * sizeof(T));
+        std::memset(__s.M_im + i, 0, n * sizeof(T));
+    }
+
+    // sum of |amplitude|^2 over the n consecutive amplitudes starting at i, in double, spread over four partial sums
+    // which shortens both the rounding error (a shallow pairwise tree) and the dependency chain of the additions
+    template <typename T>
+    static inline double norm_run(const T *p, const std::size_t &n)
+    {
+        double acc[4] = {0.0, 0.0, 0.0, 0.0};
+        std::size_t j = 0;
+        for (; j + 4 <= n; j += 4)
+            for (std::size_t l = 0; l < 4; l++)
+                acc[l] += static_cast<double>(p[j + l]) * static_cast<double>(p[j + l]);
+        for (; j < n; j++)
+            acc[0] += static_cast<double>(p[j]) * static_cast<double>(p[j]);
+        return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+    }
+
+    template <typename T>
+    static inline double norm_run(const aos_state<T> &__s, const std::size_t &i, const std::size_t &n)
+    {
+        return norm_run(reinterpret_cast<const T *>(__s.M_data + i), 2 * n);
+    }
+
+    template <typename T>
+    static inline double norm_run(const soa_state<T> &__s, const std::size_t &i, const std::size_t &n)
+    {
+        return norm_run(__s.M_re + i, n) + norm_run(__s.M_im + i, n);
+    }
+
+    // copies the n consecutive amplitudes starting at `src` to `dst`, the two ranges may overlap
+    template <typename T>
+    static inline void move_run(const aos_state<T> &__s, const std::size_t &dst, const std::size_t &src, const std::size_t &n)
+    {
+        std::memmove(static_cast<void *>(__s.M_data + dst), static_cast<const void *>(__s.M_data + src), n * sizeof(std::complex<T>));
+    }
+
+    template <typename T>
+    static inline void move_run(const soa_state<T> &__s, const std::size_t &dst, const std::size_t &src, const std::size_t &n)
+    {
+        std::memmove(__s.M_re + dst, __s.M_re + src, n * sizeof(T));
+        std::memmove(__s.M_im + dst, __s.M_im + src, n * sizeof(T));
+    }
+
+    // adds |amplitude|^2 of the amplitudes [i, i + n), n a multiple of 16, to lane[j % 16] where j is the offset from i
+    // working on the reals directly keeps the 16 (32 for interleaved storage) partial sums in vector registers
+    template <typename T>
+    static inline void norm_lanes(const aos_state<T> &__s, const std::size_t &i, const std::size_t &n, double (&lane)[16])
+    {
+        const T *p = reinterpret_cast<const T *>(__s.M_data + i);
+        double acc[32] = {};
+        for (std::size_t j = 0; j < 2 * n; j += 32)
+            for (std::size_t l = 0; l < 32; l++)
+                acc[l] += static_cast<double>(p[j + l]) * static_cast<double>(p[j + l]);
+        for (std::size_t l = 0; l < 32; l++)
+            lane[l / 2] += acc[l];
+    }
+
+    template <typename T>
+    static inline void norm_lanes(const soa_state<T> &__s, const std::size_t &i, const std::size_t &n, double (&lane)[16])
+    {
+        const T *re = __s.M_re + i, *im = __s.M_im + i;
+        double acc[16] = {};
+        for (std::size_t j = 0; j < n; j += 16)
+            for (std::size_t l = 0; l < 16; l++)
+                acc[l] += static_cast<double>(re[j + l]) * static_cast<double>(re[j + l]) + static_cast<double>(im[j + l]) * static_cast<double>(im[j + l]);
+        for (std::size_t l = 0; l < 16; l++)
+            lane[l] += acc[l];
+    }
+
+    // multiplies the amplitudes [i, i + n), n a multiple of 16, by lane[j % 16] where j is the offset from i
+    template <typename T>
+    static inline void scale_lanes(const aos_state<T> &__s, const std::size_t &i, const std::size_t &n, const double (&lane)[16])
+    {
+        T *p = reinterpret_cast<T *>(__s.M_data + i);
+        T f[32];
+        for (std::size_t l = 0; l < 32; l++)
+            f[l] = static_cast<T>(lane[l / 2]);
+        for (std::size_t j = 0; j < 2 * n; j += 32)
+            for (std::size_t l = 0; l < 32; l++)
+                p[j + l] *= f[l];
+    }
+
+    template <typename T>
+    static inline void scale_lanes(const soa_state<T> &__s, const std::size_t &i, const std::size_t &n, const double (&lane)[16])
+    {
+        T *re = __s.M_re + i, *im = __s.M_im + i;
+        T f[16];
+        for (std::size_t l = 0; l < 16; l++)
+            f[l] = static_cast<T>(lane[l]);
+        for (std::size_t j = 0; j < n; j += 16)
+            for (std::size_t l = 0; l < 16; l++)
+            {
+                re[j + l] *= f[l];
+                im[j + l] *= f[l];
+            }
+    }
+
+    // sum of v[0..n) by recursive halving, the error grows with log(n) instead of n
+    static double pairwise_sum(const double *v, const std::size_t &n)
+    {
+        if (n <= 8)
+        {
+            double s = 0.0;
+            for (std::size_t i = 0; i < n; i++)
+                s += v[i];
+            return s;
+        }
+        return pairwise_sum(v, n / 2) + pairwise_sum(v + n / 2, n - n / 2);
+    }
+
+    // exchanges the n consecutive amplitudes starting at i0 with the ones starting at i1
+    template <typename T>
+    static inline void swap_run(const aos_state<T> &__s, const std::size_t &i0, const std::size_t &i1, const std::size_t &n)
+    {
+        std::swap_ranges(__s.M_data + i0, __s.M_data + i0 + n, __s.M_data + i1);
+    }
+
+    template <typename T>
+    static inline void swap_run(const soa_state<T> &__s, const std::size_t &i0, const std::size_t &i1, const std::size_t &n)
+    {
+        std::swap_ranges(__s.M_re + i0, __s.M_re + i0 + n, __s.M_re + i1);
+        std::swap_ranges(__s.M_im + i0, __s.M_im + i0 + n, __s.M_im + i1);
+    }
+
+    // Pauli-Y on n consecutive pairs: a' = -i * b = (b.im, -b.re), b' = i * a = (-a.im, a.re)
+    template <typename T>
+    static inline void pauli_y_run(const aos_state<T> &__s, const std::size_t &i0, const std::size_t &i1, const std::size_t &n)
+    {
+        T *p0 = reinterpret_cast<T *>(__s.M_data + i0), *p1 = reinterpret_cast<T *>(__s.M_data + i1);
+        for (std::size_t j = 0; j < 2 * n; j += 2)
+        {
+            const T ar = p0[j], ai = p0[j + 1];
+            p0[j] = p1[j + 1];
+            p0[j + 1] = -p1[j];
+            p1[j] = -ai;
+            p1[j + 1] = ar;
+        }
+    }
+
+    template <typename T>
+    static inline void pauli_y_run(const soa_state<T> &__s, const std::size_t &i0, const std::size_t &i1, const std::size_t &n)
+    {
+        T *ar = __s.M_re + i0, *ai = __s.M_im + i0, *br = __s.M_re + i1, *bi = __s.M_im + i1;
+        for (std::size_t j = 0; j < n; j++)
+        {
+            const T r = ar[j], m = ai[j];
+            ar[j] = bi[j];
+            ai[j] = -br[j];
+            br[j] = -m;
+            bi[j] = r;
+        }
+    }
+
+    // out0 = m00 * a + m01 * b, out1 = m10 * a + m11 * b over n consecutive pairs starting at i0 and i1
+    template <typename T>
+    static inline void mul_2x2_run(const aos_state<T> &__s, const std::size_t &i0, const std::size_t &i1, const std::size_t &n, const complex (&__m)[2][2])
+    {
+        T m[8];
+        unpack_2x2(__m, m);
+        mul_2x2_aos(reinterpret_cast<T *>(__s.M_data + i0), reinterpret_cast<T *>(__s.M_data + i1), n, m);
+    }
+
+    template <typename T>
+    static inline void mul_2x2_run(const soa_state<T> &__s, const std::size_t &i0, const std::size_t &i1, const std::size_t &n, const complex (&__m)[2][2])
+    {
+        T m[8];
+        unpack_2x2(__m, m);
+        mul_2x2_soa(__s.M_re + i0, __s.M_im + i0, __s.M_re + i1, __s.M_im + i1, n, m);
+    }
+
+    // scalar fallback, also used for the tails that do not fill a whole vector register
+    static void apply_2x2_scalar(complex *__s, const std::size_t &kb, const std::size_t &ke, const complex (&__m)[2][2], const std::size_t &stride)
+    {
+        const complex m00 = __m[0][0], m01 = __m[0][1], m10 = __m[1][0], m11 = __m[1][1];
+
+        for_each_run(kb, ke, stride, [&](const std::size_t &i0, const std::size_t &run)
+                     {
+                         for (std::size_t j = i0; j < i0 + run; ++j)
+                         {
+                             const complex a = __s[j];
+                             const complex b = __s[j + stride];
+
+                             __s[j] = m00 * a + m01 * b;
+                             __s[j + stride] = m10 * a + m11 * b;
+                         }
+                     });
+    }
+
+    // generic 2x2 kernels: plain real arithmetic that the compiler vectorizes for the ISA of the wrapper they are inlined into
+    // a stride smaller than a vector register is walked in blocks of 2 * STRIDE amplitudes, a fixed-size step that the compiler unrolls
+    // kb and ke are multiples of STRIDE, since the thread_pool chunks are multiples of 8 pairs
+    template <std::size_t STRIDE, typename T>
+    SIMULATOR_ALWAYS_INLINE static inline void apply_2x2_aos_blocks(T *__restrict s, const std::size_t &kb, const std::size_t &ke, const T (&m)[8])
+    {
+        for (std::size_t i = 2 * kb; i < 2 * ke; i += 2 * STRIDE)
+            mul_2x2_aos(s + 2 * i, s + 2 * (i + STRIDE), STRIDE, m);
+    }
+
+    template <std::size_t STRIDE, typename T>
+    SIMULATOR_ALWAYS_INLINE static inline void apply_2x2_soa_blocks(T *__restrict re, T *__restrict im, const std::size_t &kb, const std::size_t &ke, const T (&m)[8])
+    {
+        for (std::size_t i = 2 * kb; i < 2 * ke; i += 2 * STRIDE)
+        {
+            T a_re[STRIDE], a_im[STRIDE], b_re[STRIDE], b_im[STRIDE];
+            for (std::size_t t = 0; t < STRIDE; t++)
+            {
+                a_re[t] = re[i + t];
+                a_im[t] = im[i + t];
+                b_re[t] = re[i + STRIDE + t];
+                b_im[t] = im[i + STRIDE + t];
+            }
+            mul_2x2_soa(a_re, a_im, b_re, b_im, STRIDE, m);
+            for (std::size_t t = 0; t < STRIDE; t++)
+            {
+                re[i + t] = a_re[t];
+                im[i + t] = a_im[t];
+                re[i + STRIDE + t] = b_re[t];
+                im[i + STRIDE + t] = b_im[t];
+            }
+        }
+    }
+
+    template <typename T>
+    SIMULATOR_ALWAYS_INLINE static inline void apply_2x2_aos_body(std::complex<T> *__s, const std::size_t &kb, const std::size_t &ke, const complex (&__m)[2][2], const std::size_t &stride)
+    {
+        T m[8];
+        unpack_2x2(__m, m);
+        T *s = reinterpret_cast<T *>(__s);
+
+        if (stride == 1)
+            apply_2x2_aos_blocks<1>(s, kb, ke, m);
+        else if (stride == 2)
+            apply_2x2_aos_blocks<2>(s, kb, ke, m);
+        else if (stride == 4)
+            apply_2x2_aos_blocks<4>(s, kb, ke, m);
+        else
+        {
+            for (std::size_t k = kb; k < ke;)
+            {
+                const std::size_t j = k & (stride - 1);
+                const std::size_t run = std::min(ke - k, stride - j);
+                const std::size_t i0 = ((k - j) << 1) | j;
+                mul_2x2_aos(s + 2 * i0, s + 2 * (i0 + stride), run, m);
+                k += run;
+            }
+        }
+    }
+
+    template <typename T>
+    SIMULATOR_ALWAYS_INLINE static inline void apply_2x2_soa_body(T *__restrict re, T *__restrict im, const std::size_t &kb, const std::size_t &ke, const complex (&__m)[2][2], const std::size_t &stride)
+    {
+        T m[8];
+        unpack_2x2(__m, m);
+
+        if (stride == 1)
+            apply_2x2_soa_blocks<1>(re, im, kb, ke, m);
+        else if (stride == 2)
+            apply_2x2_soa_blocks<2>(re, im, kb, ke, m);
+        else if (stride == 4)
+            apply_2x2_soa_blocks<4>(re, im, kb, ke, m);
+        else
+        {
+            for (std::size_t k = kb; k < ke;)
+            {
+                const std::size_t j = k & (stride - 1);
+                const std::size_t run = std::min(ke - k, stride - j);
+                const std::size_t i0 = ((k - j) << 1) | j;
+                mul_2x2_soa(re + i0, im + i0, re + i0 + stride, im + i0 + stride, run, m);
+                k += run;
+            }
+        }
+    }
+
+// per-ISA copies of the generic kernels: split double, interleaved float and split float
+#define SIMULATOR_GENERIC_2X2_KERNELS(SUFFIX, TARGET)                                                                                                                        \
+    TARGET static void apply_2x2_soa_##SUFFIX(double *re, double *im, const std::size_t &kb, const std::size_t &ke, const complex (&__m)[2][2], const std::size_t &stride)   \
+    {                                                                                                                                                                        \
+        apply_2x2_soa_body(re, im, kb, ke, __m, stride);                                                                                                                     \
+    }                                                                                                                                                                        \
+    TARGET static void apply_2x2_f32_##SUFFIX(std::complex<float> *__s, const std::size_t &kb, const std::size_t &ke, const complex (&__m)[2][2], const std::size_t &stride) \
+    {                                                                                                                                                                        \
+        apply_2x2_aos_body(__s, kb, ke, __m, stride);                                                                                                                        \
+    }                                                                                                                                                                        \
+    TARGET static void apply_2x2_soa_f32_##SUFFIX(float *re, float *im, const std::size_t &kb, const std::size_t &ke, const complex (&__m)[2][2], const std::size_t &stride)  \
+    {                                                                                                                                                                        \
+        apply_2x2_soa_body(re, im, kb, ke, __m, stride);                                                                                                                     \
+    }
+
+    SIMULATOR_GENERIC_2X2_KERNELS(scalar, )
+
+#if defined(SIMULATOR_KERNELS_X86)
+    SIMULATOR_GENERIC_2X2_KERNELS(sse42, SIMULATOR_TARGET_SSE42)
+    SIMULATOR_GENERIC_2X2_KERNELS(avx2, SIMULATOR_TARGET_AVX2)
+    SIMULATOR_GENERIC_2X2_KERNELS(avx512, SIMULATOR_TARGET_AVX512)
+
+    // (x_re + i x_im) * v, one complex number per register
+    SIMULATOR_TARGET_SSE42 static inline __m128d cmul_128(const __m128d &x_re, const __m128d &x_im, const __m128d &v)
+    {
+        return _mm_addsub_pd(_mm_mul_pd(x_re, v), _mm_mul_pd(x_im, _mm_shuffle_pd(v, v, 0b01)));
+    }
+
+    SIMULATOR_TARGET_SSE42 static void apply_2x2_sse42(complex *__s, const std::size_t &kb, const std::size_t &ke, const complex (&__m)[2][2], const std::size_t &stride)
+    {
+        double *s = reinterpret_cast<double *>(__s);
+        const __m128d m00r = _mm_set1_pd(__m[0][0].real()), m00i = _mm_set1_pd(__m[0][0].imag());
+        const __m128d m01r = _mm_set1_pd(__m[0][1].real()), m01i = _mm_set1_pd(__m[0][1].imag());
+        const __m128d m10r = _mm_set1_pd(__m[1][0].real()), m10i = _mm_set1_pd(__m[1][0].imag());
+        const __m128d m11r = _mm_set1_pd(__m[1][1].real()), m11i = _mm_set1_pd(__m[1][1].imag());
+
+        for_each_run(kb, ke, stride, [&](const std::size_t &i0, const std::size_t &run) SIMULATOR_TARGET_SSE42
+                     {
+                         for (std::size_t j = i0; j < i0 + run; j++)
+                         {
+                             double *p0 = s + 2 * j;
+                             double *p1 = s + 2 * (j + stride);
+                             const __m128d a = _mm_loadu_pd(p0);
+                             const __m128d b = _mm_loadu_pd(p1);
+                             _mm_storeu_pd(p0, _mm_add_pd(cmul_128(m00r, m00i, a), cmul_128(m01r, m01i, b)));
+                             _mm_storeu_pd(p1, _mm_add_pd(cmul_128(m10r, m10i, a), cmul_128(m11r, m11i, b)));
+                         }
+                     });
+    }
+
+    // (x_re + i x_im) * v for every complex number packed in v, where x_re and x_im are broadcasted per complex lane
+    // fmaddsub subtracts on the even (real) lanes and adds on the odd (imaginary) lanes
+    SIMULATOR_TARGET_AVX2 static inline __m256d cmul_256(const __m256d &x_re, const __m256d &x_im, const __m256d &v)
+    {
+        return _mm256_fmaddsub_pd(x_re, v, _mm256_mul_pd(x_im, _mm256_permute_pd(v, 0b0101)));
+    }
+
+    // out = x * a + y * b, two complex numbers per register
+    SIMULATOR_TARGET_AVX2 static inline __m256d cmul_add_256(const __m256d &x_re, const __m256d &x_im, const __m256d &a, const __m256d &y_re, const __m256d &y_im, const __m256d &b)
+    {
+        const __m256d t = _mm256_fmadd_pd(y_im, _mm256_permute_pd(b, 0b0101), _mm256_mul_pd(x_im, _mm256_permute_pd(a, 0b0101)));
+        return _mm256_fmadd_pd(x_re, a, _mm256_fmaddsub_pd(y_re, b, t));
+    }
+
+    // the zero-masking forms with every lane selected compile to the plain instructions, the unmasked intrinsics start from _mm512_undefined_pd(), which GCC 12 flags with -Wmaybe-uninitialized
+    SIMULATOR_TARGET_AVX512 static inline __m512d swap_re_im_512(const __m512d &v)
+    {
+        return _mm512_maskz_permute_pd(0xFF, v, 0b01010101);
+    }
+
+    SIMULATOR_TARGET_AVX512 static inline __m512d cmul_512(const __m512d &x_re, const __m512d &x_im, const __m512d &v)
+    {
+        return _mm512_fmaddsub_pd(x_re, v, _mm512_mul_pd(x_im, swap_re_im_512(v)));
+    }
+
+    SIMULATOR_TARGET_AVX512 static inline __m512d cmul_add_512(const __m512d &x_re, const __m512d &x_im, const __m512d &a, const __m512d &y_re, const __m512d &y_im, const __m512d &b)
+    {
+        const __m512d t = _mm512_fmadd_pd(y_im, swap_re_im_512(b), _mm512_mul_pd(x_im, swap_re_im_512(a)));
+        return _mm512_fmadd_pd(x_re, a, _mm512_fmaddsub_pd(y_re, b, t));
+    }
+
+    SIMULATOR_TARGET_AVX512 static void apply_2x2_avx512(complex *__s, const std::size_t &kb, const std::size_t &ke, const complex (&__m)[2][2], const std::size_t &stride)
+    {
+        double *s = reinterpret_cast<double *>(__s);
+
+        if (stride >= 4)
+        {
+            // 4 amplitudes of the lower half and 4 of the upper half per iteration
+            const __m512d m00r = _mm512_set1_pd(__m[0][0].real()), m00i = _mm512_set1_pd(__m[0][0].imag());
+            const __m512d m01r = _mm512_set1_pd(__m[0][1].real()), m01i = _mm512_set1_pd(__m[0][1].imag());
+            const __m512d m10r = _mm512_set1_pd(__m[1][0].real()), m10i = _mm512_set1_pd(__m[1][0].imag());
+            const __m512d m11r = _mm512_set1_pd(__m[1][1].real()), m11i = _mm512_set1_pd(__m[1][1].imag());
+
+            for_each_run(kb, ke, stride, [&](const std::size_t &i0, const std::size_t &run) SIMULATOR_TARGET_AVX512
+                         {
+                             for (std::size_t j = i0; j < i0 + run; j += 4)
+                             {
+                                 double *p0 = s + 2 * j;
+                                 double *p1 = s + 2 * (j + stride);
+                                 const __m512d a = _mm512_loadu_pd(p0);
+                                 const __m512d b = _mm512_loadu_pd(p1);
+                                 _mm512_storeu_pd(p0, cmul_add_512(m00r, m00i, a, m01r, m01i, b));
+                                 _mm512_storeu_pd(p1, cmul_add_512(m10r, m10i, a, m11r, m11i, b));
+                             }
+                         });
+            return;
+        }
+
+        if (ke - kb < 2)
+        {
+            apply_2x2_scalar(__s, kb, ke, __m, stride);
+            return;
+        }
+
+        // pairs [kb, ke) cover the contiguous amplitudes [2 * kb, 2 * ke)
+        // stride 1 -> register holds [a0, b0, a1, b1], stride 2 -> register holds [a0, a1, b0, b1]
+        // out = diag * v + off * swap(v), where swap exchanges every a with its b
+        __m512d d_re, d_im, o_re, o_im;
+        if (stride == 1)
+        {
+            d_re = _mm512_setr_pd(__m[0][0].real(), __m[0][0].real(), __m[1][1].real(), __m[1][1].real(), __m[0][0].real(), __m[0][0].real(), __m[1][1].real(), __m[1][1].real());
+            d_im = _mm512_setr_pd(__m[0][0].imag(), __m[0][0].imag(), __m[1][1].imag(), __m[1][1].imag(), __m[0][0].imag(), __m[0][0].imag(), __m[1][1].imag(), __m[1][1].imag());
+            o_re = _mm512_setr_pd(__m[0][1].real(), __m[0][1].real(), __m[1][0].real(), __m[1][0].real(), __m[0][1].real(), __m[0][1].real(), __m[1][0].real(), __m[1][0].real());
+            o_im = _mm512_setr_pd(__m[0][1].imag(), __m[0][1].imag(), __m[1][0].imag(), __m[1][0].imag(), __m[0][1].imag(), __m[0][1].imag(), __m[1][0].imag(), __m[1][0].imag());
+        }
+        else
+        {
+            d_re = _mm512_setr_pd(__m[0][0].real(), __m[0][0].real(), __m[0][0].real(), __m[0][0].real(), __m[1][1].real(), __m[1][1].real(), __m[1][1].real(), __m[1][1].real());
+            d_im = _mm512_setr_pd(__m[0][0].imag(), __m[0][0].imag(), __m[0][0].imag(), __m[0][0].imag(), __m[1][1].imag(), __m[1][1].imag(), __m[1][1].imag(), __m[1][1].imag());
+            o_re = _mm512_setr_pd(__m[0][1].real(), __m[0][1].real(), __m[0][1].real(), __m[0][1].real(), __m[1][0].real(), __m[1][0].real(), __m[1][0].real(), __m[1][0].real());
+            o_im = _mm512_setr_pd(__m[0][1].imag(), __m[0][1].imag(), __m[0][1].imag(), __m[0][1].imag(), __m[1][0].imag(), __m[1][0].imag(), __m[1][0].imag(), __m[1][0].imag());
+        }
+
+        for (std::size_t i = 2 * kb; i < 2 * ke; i += 4)
+        {
+            double *p = s + 2 * i;
+            const __m512d v = _mm512_loadu_pd(p);
+            const __m512d w = stride == 1 ? _mm512_maskz_shuffle_f64x2(0xFF, v, v, _MM_SHUFFLE(2, 3, 0, 1)) : _mm512_maskz_shuffle_f64x2(0xFF, v, v, _MM_SHUFFLE(1, 0, 3, 2));
+            _mm512_storeu_pd(p, _mm512_add_pd(cmul_512(d_re, d_im, v), cmul_512(o_re, o_im, w)));
+        }
+    }
+
+    SIMULATOR_TARGET_AVX2 static void apply_2x2_avx2(complex *__s, const std::size_t &kb, const std::size_t &ke, const complex (&__m)[2][2], const std::size_t &stride)
+    {
+        double *s = reinterpret_cast<double *>(__s);
+
+        if (stride >= 2)
+        {
+            // 2 amplitudes of the lower half and 2 of the upper half per iteration
+            const __m256d m00r = _mm256_set1_pd(__m[0][0].real()), m00i = _mm256_set1_pd(__m[0][0].imag());
+            const __m256d m01r = _mm256_set1_pd(__m[0][1].real()), m01i = _mm256_set1_pd(__m[0][1].imag());
+            const __m256d m10r = _mm256_set1_pd(__m[1][0].real()), m10i = _mm256_set1_pd(__m[1][0].imag());
+            const __m256d m11r = _mm256_set1_pd(__m[1][1].real()), m11i = _mm256_set1_pd(__m[1][1].imag());
+
+            for_each_run(kb, ke, stride, [&](const std::size_t &i0, const std::size_t &run) SIMULATOR_TARGET_AVX2
+                         {
+                             for (std::size_t j = i0; j < i0 + run; j += 2)
+                             {
+                                 double *p0 = s + 2 * j;
+                                 double *p1 = s + 2 * (j + stride);
+                                 const __m256d a = _mm256_loadu_pd(p0);
+                                 const __m256d b = _mm256_loadu_pd(p1);
+                                 _mm256_storeu_pd(p0, cmul_add_256(m00r, m00i, a, m01r, m01i, b));
+                                 _mm256_storeu_pd(p1, cmul_add_256(m10r, m10i, a, m11r, m11i, b));
+                             }
+                         });
+            return;
+        }
+
+        // stride 1 -> register holds [a, b], out = diag * [a, b] + off * [b, a]
+        const __m256d d_re = _mm256_setr_pd(__m[0][0].real(), __m[0][0].real(), __m[1][1].real(), __m[1][1].real());
+        const __m256d d_im = _mm256_setr_pd(__m[0][0].imag(), __m[0][0].imag(), __m[1][1].imag(), __m[1][1].imag());
+        const __m256d o_re = _mm256_setr_pd(__m[0][1].real(), __m[0][1].real(), __m[1][0].real(), __m[1][0].real());
+        const __m256d o_im = _mm256_setr_pd(__m[0][1].imag(), __m[0][1].imag(), __m[1][0].imag(), __m[1][0].imag());
+
+        for (std::size_t i = 2 * kb; i < 2 * ke; i += 2)
+        {
+            double *p = s + 2 * i;
+            const __m256d v = _mm256_loadu_pd(p);
+            const __m256d w = _mm256_permute2f128_pd(v, v, 0x01);
+            _mm256_storeu_pd(p, _mm256_add_pd(cmul_256(d_re, d_im, v), cmul_256(o_re, o_im, w)));
+        }
+    }
+#endif
+
+    // one set of kernels per ISA level
+    struct isa_table
+    {
+        const char *name;
+        void (*apply_2x2)(complex *, const std::size_t &, const std::size_t &, const complex (&)[2][2], const std::size_t &);
+        void (*apply_2x2_soa)(double *, double *, const std::size_t &, const std::size_t &, const complex (&)[2][2], const std::size_t &);
+        void (*apply_2x2_f32)(std::complex<float> *, const std::size_t &, const std::size_t &, const complex (&)[2][2], const std::size_t &);
+        void (*apply_2x2_soa_f32)(float *, float *, const std::size_t &, const std::size_t &, const complex (&)[2][2], const std::size_t &);
+    };
+
+    static constexpr isa_table isa_tables[] = {
+#if defined(SIMULATOR_KERNELS_X86)
+        {"avx512", apply_2x2_avx512, apply_2x2_soa_avx512, apply_2x2_f32_avx512, apply_2x2_soa_f32_avx512},
+        {"avx2", apply_2x2_avx2, apply_2x2_soa_avx2, apply_2x2_f32_avx2, apply_2x2_soa_f32_avx2},
+        {"sse4.2", apply_2x2_sse42, apply_2x2_soa_sse42, apply_2x2_f32_sse42, apply_2x2_soa_f32_sse42},
+#endif
+        {"scalar", apply_2x2_scalar, apply_2x2_soa_scalar, apply_2x2_f32_scalar, apply_2x2_soa_f32_scalar}};
+
+    // picks the widest kernel set the CPU (and OS) supports, QUBITVERSE_ISA can force a narrower one
+    static const isa_table &select_isa()
+    {
+        std::size_t best = sizeof(isa_tables) / sizeof(isa_tables[0]) - 1;
+#if defined(SIMULATOR_KERNELS_X86)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+            best = 0;
+        else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            best = 1;
+        else if (__builtin_cpu_supports("sse4.2"))
+            best = 2;
+#endif
+
+        if (const char *env = std::getenv("QUBITVERSE_ISA"))
+        {
+            std::size_t i = 0;
+            while (i < sizeof(isa_tables) / sizeof(isa_tables[0]) && std::strcmp(isa_tables[i].name, env) != 0)
+                i++;
+            if (i == sizeof(isa_tables) / sizeof(isa_tables[0]))
+                std::fprintf(stderr, "warning: unknown QUBITVERSE_ISA '%s', using '%s'\n", env, isa_tables[best].name);
+            else if (i < best)
+                std::fprintf(stderr, "warning: QUBITVERSE_ISA '%s' is not supported by this CPU, using '%s'\n", env, isa_tables[best].name);
+            else
+                best = i;
+        }
+        return isa_tables[best];
+    }
+
+    static const isa_table &active()
+    {
+        static const isa_table &table = select_isa();
+        return table;
+    }
+
+    // runs the selected ISA kernel of the matching layout and precision on the pairs [kb, ke)
+    static inline void apply_2x2_range(const isa_table &isa, const aos_state<double> &__s, const std::size_t &kb, const std::size_t &ke, const complex (&__m)[2][2], const std::size_t &stride)
+    {
+        isa.apply_2x2(__s.M_data, kb, ke, __m, stride);
+    }
+
+    static inline void apply_2x2_range(const isa_table &isa, const soa_state<double> &__s, const std::size_t &kb, const std::size_t &ke, const complex (&__m)[2][2], const std::size_t &stride)
+    {
+        isa.apply_2x2_soa(__s.M_re, __s.M_im, kb, ke, __m, stride);
+    }
+
+    static inline void apply_2x2_range(const isa_table &isa, const aos_state<float> &__s, const std::size_t &kb, const std::size_t &ke, const complex (&__m)[2][2], const std::size_t &stride)
+    {
+        isa.apply_2x2_f32(__s.M_data, kb, ke, __m, stride);
+    }
+
+    static inline void apply_2x2_range(const isa_table &isa, const soa_state<float> &__s, const std::size_t &kb, const std::size_t &ke, const complex (&__m)[2][2], const std::size_t &stride)
+    {
+        isa.apply_2x2_soa_f32(__s.M_re, __s.M_im, kb, ke, __m, stride);
+    }
+
+    template <typename S>
+    void apply_2x2(const S &__s, const std::size_t &_len, const complex (&__m)[2][2], const std::size_t &qubit_target)
+    {
+        const std::size_t stride = std::size_t(1) << qubit_target; // Distance between paired indices
+        const isa_table &isa = active();
+
+        // chunks of 8 pairs keep every vector iteration inside a single chunk
+        thread_pool::instance().parallel_for(0, _len / 2, 8, 2, [&](const std::size_t &kb, const std::size_t &ke)
+                                             { apply_2x2_range(isa, __s, kb, ke, __m, stride); });
+    }
+
+    template <typename S>
+    void apply_diagonal(const S &__s, const std::size_t &_len, const complex &d0, const complex &d1, const std::size_t &qubit_target)
+    {
+        const std::size_t stride = std::size_t(1) << qubit_target;
+        const bool touch0 = d0 != complex(1.0, 0.0), touch1 = d1 != complex(1.0, 0.0);
+        if (!touch0 && !touch1)
+            return;
+
+        thread_pool::instance().parallel_for(0, _len / 2, 8, 2, [&](const std::size_t &kb, const std::size_t &ke)
+                                             {
+                                                 for_each_run(kb, ke, stride, [&](const std::size_t &i0, const std::size_t &run)
+                                                              {
+                                                                  if (touch0)
+                                                                      scale_run(__s, i0, run, d0);
+                                                                  if (touch1)
+                                                                      scale_run(__s, i0 + stride, run, d1);
+                                                              });
+                                             });
+    }
+
+    template <typename S>
+    void apply_controlled_phase(const S &__s, const std::size_t &_len, const complex &phase, const std::size_t &q_control, const std::size_t &q_target)
+    {
+        if (q_control == q_target)
+        {
+            kernels::apply_diagonal(__s, _len, 1.0, phase, q_target);
+            return;
+        }
+
+        const std::size_t bits[2] = {std::min(q_control, q_target), std::max(q_control, q_target)};
+        const std::size_t mask = (std::size_t(1) << q_control) | (std::size_t(1) << q_target);
+
+        thread_pool::instance().parallel_for(0, _len / 4, 8, 1, [&](const std::size_t &kb, const std::size_t &ke)
+                                             {
+                                                 for_each_subspace_run(kb, ke, bits, 2, [&](const std::size_t &i0, const std::size_t &run)
+                                                                       { scale_run(__s, i0 | mask, run, phase); });
+                                             });
+    }
+
+    template <typename S>
+    void apply_pauli_x(const S &__s, const std::size_t &_len, const std::size_t &qubit_target)
+    {
+        const std::size_t stride = std::size_t(1) << qubit_target;
+        thread_pool::instance().parallel_for(0, _len / 2, 8, 2, [&](const std::size_t &kb, const std::size_t &ke)
+                                             {
+                                                 for_each_run(kb, ke, stride, [&](const std::size_t &i0, const std::size_t &run)
+                                                              { swap_run(__s, i0, i0 + stride, run); });
+                                             });
+    }
+
+    template <typename S>
+    void apply_pauli_y(const S &__s, const std::size_t &_len, const std::size_t &qubit_target)
+    {
+        const std::size_t stride = std::size_t(1) << qubit_target;
+        thread_pool::instance().parallel_for(0, _len / 2, 8, 2, [&](const std::size_t &kb, const std::size_t &ke)
+                                             {
+                                                 for_each_run(kb, ke, stride, [&](const std::size_t &i0, const std::size_t &run)
+                                                              { pauli_y_run(__s, i0, i0 + stride, run); });
+                                             });
+    }
+
+    // swaps the amplitude pairs (base | m0, base | m1) for every base that has 0 on both `q0` and `q1`
+    template <typename S>
+    static void swap_subspace_pairs(const S &__s, const std::size_t &_len, const std::size_t &q0, const std::size_t &q1, const std::size_t &m0, const std::size_t &m1)
+    {
+        const std::size_t bits[2] = {std::min(q0, q1), std::max(q0, q1)};
+        thread_pool::instance().parallel_for(0, _len / 4, 8, 2, [&](const std::size_t &kb, const std::size_t &ke)
+                                             {
+                                                 for_each_subspace_run(kb, ke, bits, 2, [&](const std::size_t &i0, const std::size_t &run)
+                                                                       { swap_run(__s, i0 | m0, i0 | m1, run); });
+                                             });
+    }
+
+    template <typename S>
+    void apply_cnot(const S &__s, const std::size_t &_len, const std::size_t &q_control, const std::size_t &q_target)
+    {
+        if (q_control == q_target)
+            return;
+        const std::size_t c = std::size_t(1) << q_control, t = std::size_t(1) << q_target;
+        swap_subspace_pairs(__s, _len, q_control, q_target, c, c | t);
+    }
+
+    template <typename S>
+    void apply_swap(const S &__s, const std::size_t &_len, const std::size_t &qubit_1, const std::size_t &qubit_2)
+    {
+        if (qubit_1 == qubit_2)
+            return;
+        swap_subspace_pairs(__s, _len, qubit_1, qubit_2, std::size_t(1) << qubit_1, std::size_t(1) << qubit_2);
+    }
+
+    template <typename S>
+    void qubit_probabilities(const S &__s, const std::size_t &_len, const std::size_t &qubit_target, double &p0, double &p1)
+    {
+        // pairs per partial sum, fixed so that the result does not depend on the thread count
+        constexpr std::size_t block = std::size_t(1) << 12;
+        const std::size_t stride = std::size_t(1) << qubit_target, pairs = _len / 2;
+        std::vector<double> part0((pairs + block - 1) / block), part1(part0.size());
+        thread_pool::instance().parallel_for(0, pairs, block, 2, [&](const std::size_t &kb, const std::size_t &ke)
+                                             {
+                                                 for (std::size_t k = kb; k < ke; k += block)
+                                                 {
+                                                     double s[2] = {0.0, 0.0};
+                                                     const std::size_t kn = std::min(ke, k + block);
+                                                     // runs shorter than 16 amplitudes cost more to enumerate than to read: the block, whose amplitudes are contiguous, is swept
+                                                     // in 16 lanes, a multiple of the period of the bit, so that the lane alone tells the half an amplitude belongs to
+                                                     if (stride < 16)
+                                                     {
+                                                         double lane[16] = {};
+                                                         const std::size_t n = 2 * (kn - k), whole = n / 16 * 16;
+                                                         norm_lanes(__s, 2 * k, whole, lane);
+                                                         for (std::size_t i = 2 * k + whole; i < 2 * kn; i++)
+                                                             s[(i >> qubit_target) & 1] += std::norm(load(__s, i));
+                                                         for (std::size_t l = 0; l < 16; l++)
+                                                             s[(l >> qubit_target) & 1] += lane[l];
+                                                     }
+                                                     else
+                                                         for_each_run(k, kn, stride, [&](const std::size_t &i0, const std::size_t &run)
+                                                                      {
+                                                                          s[0] += norm_run(__s, i0, run);
+                                                                          s[1] += norm_run(__s, i0 + stride, run);
+                                                                      });
+                                                     part0[k / block] = s[0];
+                                                     part1[k / block] = s[1];
+                                                 }
+                                             });
+        p0 = pairwise_sum(part0.data(), part0.size());
+        p1 = pairwise_sum(part1.data(), part1.size());
+    }
+
+    template <typename S>
+    void collapse_qubit(const S &__s, const std::size_t &_len, const std::size_t &qubit_target, const std::size_t &outcome, const double &scale)
+    {
+        const std::size_t stride = std::size_t(1) << qubit_target;
+        if (stride < 16)
+        {
+            // short runs: one contiguous sweep in 16 lanes, every amplitude is multiplied by `scale` or by 0 depending on its lane
+            const double factor[2] = {outcome ? 0.0 : scale, outcome ? scale : 0.0};
+            double lane[16];
+            for (std::size_t l = 0; l < 16; l++)
+                lane[l] = factor[(l >> qubit_target) & 1];
+            thread_pool::instance().parallel_for(0, _len, 16, 1, [&](const std::size_t &b, const std::size_t &e)
+                                                 {
+                                                     const std::size_t whole = (e - b) / 16 * 16;
+                                                     scale_lanes(__s, b, whole, lane);
+                                                     for (std::size_t i = b + whole; i < e; i++)
+                                                         store(__s, i, load(__s, i) * factor[(i >> qubit_target) & 1]);
+                                                 });
+            return;
+        }
+        const std::size_t keep = outcome ? stride : 0, drop = outcome ? 0 : stride;
+        thread_pool::instance().parallel_for(0, _len / 2, 8, 2, [&](const std::size_t &kb, const std::size_t &ke)
+                                             {
+                                                 for_each_run(kb, ke, stride, [&](const std::size_t &i0, const std::size_t &run)
+                                                              {
+                                                                  scale_run(__s, i0 + keep, run, scale);
+                                                                  zero_run(__s, i0 + drop, run);
+                                                              });
+                                             });
+    }
+
+    template <typename S>
+    void compact_qubit(const S &__s, const std::size_t &_len, const std::size_t &qubit_target, const std::size_t &outcome)
+    {
+        // amplitude k of the result comes from index insert_zero_bits(k) + from >= k, so an ascending sweep never overwrites an amplitude it still has to read
+        // the ranges read and written by different parts of the sweep overlap, which is why it is not split over the thread pool
+        const std::size_t stride = std::size_t(1) << qubit_target, from = outcome ? stride : 0;
+        if (stride < 16)
+        {
+            for (std::size_t k = 0; k < _len / 2; k++)
+                store(__s, k, load(__s, insert_zero_bits(k, &qubit_target, 1) + from));
+            return;
+        }
+        for (std::size_t i0 = 0, k = 0; i0 < _len; i0 += 2 * stride, k += stride)
+            move_run(__s, k, i0 + from, stride);
+    }
+
+    template <typename S>
+    void expand_qubit(const S &__s, const std::size_t &_len, const std::size_t &qubit_target, const std::size_t &value)
+    {
+        // the reverse of compact_qubit: a descending sweep, amplitude k moves up to insert_zero_bits(k) + to >= k
+        const std::size_t stride = std::size_t(1) << qubit_target, to = value ? stride : 0, other = value ? 0 : stride;
+        if (stride < 16)
+        {
+            for (std::size_t k = _len / 2; k-- > 0;)
+            {
+                const std::size_t i = insert_zero_bits(k, &qubit_target, 1);
+                const complex a = load(__s, k);
+                store(__s, i + to, a);
+                store(__s, i + other, 0);
+            }
+            return;
+        }
+        for (std::size_t i0 = _len, k = _len / 2; i0 > 0;)
+        {
+            i0 -= 2 * stride;
+            k -= stride;
+            move_run(__s, i0 + to, k, stride);
+            zero_run(__s, i0 + other, stride);
+        }
+    }
+
+    template <typename S>
+    void apply_controlled_2x2(const S &__s, const std::size_t &_len, const std::size_t *controls, const std::size_t &nc, const complex (&__m)[2][2], const std::size_t &qubit_target)
+    {
+        const std::size_t stride = std::size_t(1) << qubit_target;
+        std::vector<std::size_t> bits(controls, controls + nc);
+        bits.push_back(qubit_target);
+        std::sort(bits.begin(), bits.end());
+
+        std::size_t cmask = 0;
+        for (std::size_t i = 0; i < nc; i++)
+            cmask |= std::size_t(1) << controls[i];
+
+        const bool is_x = __m[0][0] == 0.0 && __m[0][1] == 1.0 && __m[1][0] == 1.0 && __m[1][1] == 0.0;
+        const bool is_diagonal = __m[0][1] == 0.0 && __m[1][0] == 0.0;
+
+        // k enumerates the 2^(n - nc - 1) indices with the control and target bits removed, the controls are then forced to 1
+        thread_pool::instance().parallel_for(0, _len >> (nc + 1), 8, 2, [&](const std::size_t &kb, const std::size_t &ke)
+                                             {
+                                                 for_each_subspace_run(kb, ke, bits.data(), bits.size(), [&](const std::size_t &i0, const std::size_t &run)
+                                                                       {
+                                                                           const std::size_t p0 = i0 | cmask, p1 = p0 + stride;
+                                                                           if (is_x)
+                                                                               swap_run(__s, p0, p1, run);
+                                                                           else if (is_diagonal)
+                                                                           {
+                                                                               if (__m[0][0] != 1.0)
+                                                                                   scale_run(__s, p0, run, __m[0][0]);
+                                                                               if (__m[1][1] != 1.0)
+                                                                                   scale_run(__s, p1, run, __m[1][1]);
+                                                                           }
+                                                                           else
+                                                                               mul_2x2_run(__s, p0, p1, run, __m);
+                                                                       });
+                                             });
+    }
+
+    // number of consecutive sub-space indices processed together by the matrix kernels, each matrix entry is loaded once per batch
+    static constexpr std::size_t matrix_batch = 8;
+
+    // unrolled kernel for a fixed number of targets K, the gathered amplitudes are kept as separate real and imaginary parts so that the batch loop vectorizes
+    template <std::size_t K, typename S>
+    static void apply_matrix_fixed(const S &__s, const std::size_t &kb, const std::size_t &ke, const std::size_t *sorted, const std::size_t *offset, const typename S::value_type *m_re, const typename S::value_type *m_im)
+    {
+        using T = typename S::value_type;
+        constexpr std::size_t dim = std::size_t(1) << K;
+        constexpr std::size_t B = matrix_batch;
+
+        for (std::size_t k0 = kb; k0 < ke; k0 += B)
+        {
+            const std::size_t nb = std::min(B, ke - k0);
+            std::size_t base[B];
+            T in_re[dim][B], in_im[dim][B];
+            for (std::size_t j = 0; j < nb; j++)
+                base[j] = insert_zero_bits(k0 + j, sorted, K);
+            for (std::size_t r = 0; r < dim; r++)
+            {
+                for (std::size_t j = 0; j < nb; j++)
+                {
+                    const complex z = load(__s, base[j] | offset[r]);
+                    in_re[r][j] = static_cast<T>(z.real());
+                    in_im[r][j] = static_cast<T>(z.imag());
+                }
+                // only the last batch of a range has unused lanes, they are computed with the others and never stored
+                for (std::size_t j = nb; j < B; j++)
+                    in_re[r][j] = in_im[r][j] = 0;
+            }
+
+            for (std::size_t r = 0; r < dim; r++)
+            {
+                T acc_re[B] = {}, acc_im[B] = {};
+                for (std::size_t c = 0; c < dim; c++)
+                {
+                    const T mr = m_re[r * dim + c], mi = m_im[r * dim + c];
+                    for (std::size_t j = 0; j < B; j++)
+                    {
+                        acc_re[j] += mr * in_re[c][j] - mi * in_im[c][j];
+                        acc_im[j] += mr * in_im[c][j] + mi * in_re[c][j];
+                    }
+                }
+                for (std::size_t j = 0; j < nb; j++)
+                    store(__s, base[j] | offset[r], complex(acc_re[j], acc_im[j]));
+            }
+        }
+    }
+
+    // groups gathered at once by the general path, and the rows and columns of the matrix tiles applied to them
+    // a tile (64 KiB of double) stays in L2 while it is applied to every batch of the block, so the matrix is read once per matrix_block groups rather than once per batch
+    static constexpr std::size_t matrix_block = 8 * matrix_batch;
+    static constexpr std::size_t matrix_tile = 64;
+
+    // general path for any number of targets, a block of groups is gathered batch by batch ([batch][row][lane], every batch as the fixed kernels lay it out)
+    // and the matrix is applied to the whole block one tile at a time
+    template <typename S>
+    static void apply_matrix_general(const S &__s, const std::size_t &kb, const std::size_t &ke, const std::size_t *sorted, const std::size_t &k, const std::size_t *offset, const typename S::value_type *m_re, const typename S::value_type *m_im)
+    {
+        using T = typename S::value_type;
+        const std::size_t dim = std::size_t(1) << k, tile = std::min(matrix_tile, dim);
+        constexpr std::size_t B = matrix_batch, G = matrix_block;
+
+        std::size_t base[G];
+        std::vector<T> in_re(dim * G), in_im(dim * G), out_re(dim * G), out_im(dim * G);
+        for (std::size_t k0 = kb; k0 < ke; k0 += G)
+        {
+            // groups of this block, and the batches holding them
+            const std::size_t ng = std::min(G, ke - k0), nbatch = (ng + B - 1) / B;
+            for (std::size_t j = 0; j < ng; j++)
+                base[j] = insert_zero_bits(k0 + j, sorted, k);
+            for (std::size_t b = 0; b < nbatch; b++)
+            {
+                const std::size_t nb = std::min(B, ng - b * B);
+                T *xr = &in_re[b * dim * B], *xi = &in_im[b * dim * B];
+                for (std::size_t r = 0; r < dim; r++)
+                {
+                    for (std::size_t j = 0; j < nb; j++)
+                    {
+                        const complex z = load(__s, base[b * B + j] | offset[r]);
+                        xr[r * B + j] = static_cast<T>(z.real());
+                        xi[r * B + j] = static_cast<T>(z.imag());
+                    }
+                    for (std::size_t j = nb; j < B; j++)
+                        xr[r * B + j] = xi[r * B + j] = 0;
+                }
+            }
+
+            for (std::size_t r0 = 0; r0 < dim; r0 += tile)
+                for (std::size_t c0 = 0; c0 < dim; c0 += tile)
+                    for (std::size_t b = 0; b < nbatch; b++)
+                    {
+                        const T *xr = &in_re[b * dim * B], *xi = &in_im[b * dim * B];
+                        T *yr = &out_re[b * dim * B], *yi = &out_im[b * dim * B];
+                        for (std::size_t r = r0; r < r0 + tile; r++)
+                        {
+                            // the first column tile starts the sums of its rows, the next ones add to them
+                            T acc_re[B] = {}, acc_im[B] = {};
+                            if (c0 != 0)
+                                for (std::size_t j = 0; j < B; j++)
+                                {
+                                    acc_re[j] = yr[r * B + j];
+                                    acc_im[j] = yi[r * B + j];
+                                }
+                            for (std::size_t c = c0; c < c0 + tile; c++)
+                            {
+                                const T mr = m_re[r * dim + c], mi = m_im[r * dim + c];
+                                for (std::size_t j = 0; j < B; j++)
+                                {
+                                    acc_re[j] += mr * xr[c * B + j] - mi * xi[c * B + j];
+                                    acc_im[j] += mr * xi[c * B + j] + mi * xr[c * B + j];
+                                }
+                            }
+                            for (std::size_t j = 0; j < B; j++)
+                            {
+                                yr[r * B + j] = acc_re[j];
+                                yi[r * B + j] = acc_im[j];
+                            }
+                        }
+                    }
+
+            for (std::size_t b = 0; b < nbatch; b++)
+            {
+                const std::size_t nb = std::min(B, ng - b * B);
+                const T *yr = &out_re[b * dim * B], *yi = &out_im[b * dim * B];
+                for (std::size_t r = 0; r < dim; r++)
+                    for (std::size_t j = 0; j < nb; j++)
+                        store(__s, base[b * B + j] | offset[r], complex(yr[r * B + j], yi[r * B + j]));
+            }
+        }
+    }
+
+    template <typename S>
+    void apply_matrix(const S &__s, const std::size_t &_len, const std::size_t *targets, const std::size_t &k, const complex *__m)
+    {
+        if (k == 1)
+        {
+            const complex m[2][2] = {{__m[0], __m[1]}, {__m[2], __m[3]}};
+            kernels::apply_2x2(__s, _len, m, targets[0]);
+            return;
+        }
+
+        const std::size_t dim = std::size_t(1) << k;
+        std::vector<std::size_t> sorted(targets, targets + k), offset(dim, 0);
+        std::sort(sorted.begin(), sorted.end());
+
+        // offset[r] places the bits of the local index r on the target bits of the state-vector index
+        for (std::size_t r = 0; r < dim; r++)
+            for (std::size_t b = 0; b < k; b++)
+                if ((r >> b) & 1)
+                    offset[r] |= std::size_t(1) << targets[b];
+
+        using T = typename S::value_type;
+        std::vector<T> m_re(dim * dim), m_im(dim * dim);
+        for (std::size_t i = 0; i < dim * dim; i++)
+        {
+            m_re[i] = static_cast<T>(__m[i].real());
+            m_im[i] = static_cast<T>(__m[i].imag());
+        }
+
+        thread_pool::instance().parallel_for(0, _len >> k, matrix_batch, std::size_t(1) << k, [&](const std::size_t &kb, const std::size_t &ke)
+                                             {
+                                                 switch (k)
+                                                 {
+                                                 case 2:
+                                                     apply_matrix_fixed<2>(__s, kb, ke, sorted.data(), offset.data(), m_re.data(), m_im.data());
+                                                     break;
+                                                 case 3:
+                                                     apply_matrix_fixed<3>(__s, kb, ke, sorted.data(), offset.data(), m_re.data(), m_im.data());
+                                                     break;
+                                                 case 4:
+                                                     apply_matrix_fixed<4>(__s, kb, ke, sorted.data(), offset.data(), m_re.data(), m_im.data());
+                                                     break;
+                                                 case 5:
+                                                     apply_matrix_fixed<5>(__s, kb, ke, sorted.data(), offset.data(), m_re.data(), m_im.data());
+                                                     break;
+                                                 default:
+                                                     apply_matrix_general(__s, kb, ke, sorted.data(), k, offset.data(), m_re.data(), m_im.data());
+                                                     break;
+                                                 }
+                                             });
+    }
+
+    const char *active_isa()
+    {
+        return active().name;
+    }
+
+// every kernel is compiled once per state-vector layout and precision
+#define SIMULATOR_KERNELS_INSTANTIATE(S)                                                                                                                         \
+    template void apply_2x2<S>(const S &, const std::size_t &, const complex (&)[2][2], const std::size_t &);                                                   \
+    template void apply_diagonal<S>(const S &, const std::size_t &, const complex &, const complex &, const std::size_t &);                                     \
+    template void apply_controlled_phase<S>(const S &, const std::size_t &, const complex &, const std::size_t &, const std::size_t &);                         \
+    template void apply_pauli_x<S>(const S &, const std::size_t &, const std::size_t &);                                                                        \
+    template void apply_pauli_y<S>(const S &, const std::size_t &, const std::size_t &);                                                                        \
+    template void apply_cnot<S>(const S &, const std::size_t &, const std::size_t &, const std::size_t &);                                                      \
+    template void apply_swap<S>(const S &, const std::size_t &, const std::size_t &, const std::size_t &);                                                      \
+    template void apply_controlled_2x2<S>(const S &, const std::size_t &, const std::size_t *, const std::size_t &, const complex (&)[2][2], const std::size_t &); \
+    template void apply_matrix<S>(const S &, const std::size_t &, const std::size_t *, const std::size_t &, const complex *);                                 \
+    template void qubit_probabilities<S>(const S &, const std::size_t &, const std::size_t &, double &, double &);                                              \
+    template void collapse_qubit<S>(const S &, const std::size_t &, const std::size_t &, const std::size_t &, const double &);                                  \
+    template void compact_qubit<S>(const S &, const std::size_t &, const std::size_t &, const std::size_t &);                                                  \
+    template void expand_qubit<S>(const S &, const std::size_t &, const std::size_t &, const std::size_t &);
+
+    SIMULATOR_KERNELS_INSTANTIATE(aos_state<double>)
+    SIMULATOR_KERNELS_INSTANTIATE(soa_state<double>)
+    SIMULATOR_KERNELS_INSTANTIATE(aos_state<float>)
+    SIMULATOR_KERNELS_INSTANTIATE(soa_state<float>)
+
+#undef SIMULATOR_KERNELS_INSTANTIATE
+}
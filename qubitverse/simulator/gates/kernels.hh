@@ -0,0 +1,118 @@
+/**
+ * @file kernels.hh
+ * @license This file is licensed under the GNU GENERAL PUBLIC LICENSE Version 3, 29 June 2007. You may obtain a copy of this license at https://www.gnu.org/licenses/gpl-3.0.en.html.
+ * @author Tushar Chaurasia (Dark-CodeX)
+ */
+
+#ifndef SIMULATOR_KERNELS
+#define SIMULATOR_KERNELS
+
+#include <complex>
+#include <cstddef>
+
+namespace simulator::kernels
+{
+    using complex = std::complex<double>;
+
+    // non-owning views of a state-vector, every kernel is instantiated for both layouts in double (T = double) and single (T = float) precision
+    // the gate matrices are always given in double precision and rounded to T once per gate
+    // interleaved storage (array-of-structures): re0, im0, re1, im1, ...
+    template <typename T>
+    struct aos_state
+    {
+        using value_type = T;
+        std::complex<T> *M_data;
+    };
+
+    // split storage (structure-of-arrays): the real and the imaginary parts live in two separate arrays, so complex arithmetic needs no shuffles
+    template <typename T>
+    struct soa_state
+    {
+        using value_type = T;
+        T *M_re, *M_im;
+    };
+
+    // amplitudes are read and written as complex<double> whatever the precision of the state-vector
+    template <typename T>
+    inline complex load(const aos_state<T> &__s, const std::size_t &i)
+    {
+        return complex(__s.M_data[i].real(), __s.M_data[i].imag());
+    }
+
+    template <typename T>
+    inline complex load(const soa_state<T> &__s, const std::size_t &i)
+    {
+        return {__s.M_re[i], __s.M_im[i]};
+    }
+
+    template <typename T>
+    inline void store(const aos_state<T> &__s, const std::size_t &i, const complex &z)
+    {
+        __s.M_data[i] = std::complex<T>(static_cast<T>(z.real()), static_cast<T>(z.imag()));
+    }
+
+    template <typename T>
+    inline void store(const soa_state<T> &__s, const std::size_t &i, const complex &z)
+    {
+        __s.M_re[i] = static_cast<T>(z.real());
+        __s.M_im[i] = static_cast<T>(z.imag());
+    }
+
+    // applies a dense 2x2 matrix on the `qubit_target` of the state-vector `__s`, the matrix is read once and kept in registers
+    // the widest kernel set the CPU supports (AVX-512, AVX2+FMA, SSE4.2 or scalar) is selected once at runtime, large states are split across the thread_pool
+    // interleaved double precision states use hand-written intrinsics, the other three variants are generic loops compiled once per ISA level
+    template <typename S>
+    void apply_2x2(const S &__s, const std::size_t &_len, const complex (&__m)[2][2], const std::size_t &qubit_target);
+
+    // applies the diagonal gate diag(d0, d1) on `qubit_target`, the half of the state-vector whose entry is 1 is skipped entirely
+    // d = -1 is applied as a sign flip, any other value as a single complex multiply per amplitude
+    template <typename S>
+    void apply_diagonal(const S &__s, const std::size_t &_len, const complex &d0, const complex &d1, const std::size_t &qubit_target);
+
+    // multiplies by `phase` only the quarter of the state-vector where both `q_control` and `q_target` are 1 (phase = -1 is CZ)
+    template <typename S>
+    void apply_controlled_phase(const S &__s, const std::size_t &_len, const complex &phase, const std::size_t &q_control, const std::size_t &q_target);
+
+    // permutation kernels: only the affected index pairs are enumerated (by inserting the target/control bits into a counter) and swapped, no multiplies
+    template <typename S>
+    void apply_pauli_x(const S &__s, const std::size_t &_len, const std::size_t &qubit_target);
+    template <typename S>
+    void apply_pauli_y(const S &__s, const std::size_t &_len, const std::size_t &qubit_target); // swap plus a phase of -i / i, done with sign flips
+    template <typename S>
+    void apply_cnot(const S &__s, const std::size_t &_len, const std::size_t &q_control, const std::size_t &q_target);
+    template <typename S>
+    void apply_swap(const S &__s, const std::size_t &_len, const std::size_t &qubit_1, const std::size_t &qubit_2);
+
+    // applies `__m` on `qubit_target` only where all of the `nc` qubits in `controls` are 1, only those 2^(n - nc) amplitudes are visited
+    // X is applied as a swap and diagonal matrices as a scaling of the affected amplitudes
+    template <typename S>
+    void apply_controlled_2x2(const S &__s, const std::size_t &_len, const std::size_t *controls, const std::size_t &nc, const complex (&__m)[2][2], const std::size_t &qubit_target);
+
+    // applies a dense 2^k x 2^k matrix `__m` (row-major) on the `k` distinct qubits `targets`, where targets[0] is the least significant bit of the matrix index
+    // k = 1 uses the SIMD 2x2 kernels, k = 2..5 have unrolled kernels, larger k uses a general kernel that applies each row to a batch of groups
+    template <typename S>
+    void apply_matrix(const S &__s, const std::size_t &_len, const std::size_t *targets, const std::size_t &k, const complex *__m);
+
+    // |amplitude|^2 summed over the halves of the state-vector where `qubit_target` is 0 (p0) and 1 (p1), both halves are walked as runs of the pair enumeration
+    // fixed blocks of partial sums are added pairwise, so the result is accurate for large states and independent of the thread count
+    template <typename S>
+    void qubit_probabilities(const S &__s, const std::size_t &_len, const std::size_t &qubit_target, double &p0, double &p1);
+
+    // projects `qubit_target` onto `outcome` in one pass: the kept half is multiplied by `scale`, the other half is cleared with memset
+    template <typename S>
+    void collapse_qubit(const S &__s, const std::size_t &_len, const std::size_t &qubit_target, const std::size_t &outcome, const double &scale);
+
+    // keeps the half of the `_len` amplitudes where `qubit_target` is `outcome` and packs it into the first _len / 2 amplitudes, in place
+    // the index bits above `qubit_target` move down by one, the upper half is left as it was
+    template <typename S>
+    void compact_qubit(const S &__s, const std::size_t &_len, const std::size_t &qubit_target, const std::size_t &outcome);
+
+    // the inverse of compact_qubit: spreads the first _len / 2 amplitudes over the `_len` amplitudes with a new `qubit_target` in the basis state `value`, the other half is cleared
+    template <typename S>
+    void expand_qubit(const S &__s, const std::size_t &_len, const std::size_t &qubit_target, const std::size_t &value);
+
+    // name of the kernel set selected at runtime, `QUBITVERSE_ISA` forces a narrower one ("avx2", "sse4.2" or "scalar")
+    const char *active_isa();
+}
+
+#endif
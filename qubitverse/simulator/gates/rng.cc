@@ -0,0 +1,76 @@
+/**
+ * @file rng.cc
+ * @license This file is licensed under the GNU GENERAL PUBLIC LICENSE Version 3, 29 June 2007. You may obtain a copy of this license at https://www.gnu.org/licenses/gpl-3.0.en.html.
+ * @author Tushar Chaurasia (Dark-CodeX)
+ */
+
+#include "./rng.hh"
+#include <atomic>
+#include <random>
+
+namespace simulator
+{
+    rng::rng(const std::uint64_t &seed, const std::uint64_t &stream)
+        : M_key{static_cast<std::uint32_t>(seed), static_cast<std::uint32_t>(seed >> 32)},
+          M_counter{0, 0, static_cast<std::uint32_t>(stream), static_cast<std::uint32_t>(stream >> 32)},
+          M_block{}, M_used(2) {}
+
+    static inline void mulhilo(const std::uint32_t &a, const std::uint32_t &b, std::uint32_t &hi, std::uint32_t &lo)
+    {
+        const std::uint64_t p = static_cast<std::uint64_t>(a) * b;
+        hi = static_cast<std::uint32_t>(p >> 32);
+        lo = static_cast<std::uint32_t>(p);
+    }
+
+    void rng::refill()
+    {
+        std::uint32_t c[4] = {this->M_counter[0], this->M_counter[1], this->M_counter[2], this->M_counter[3]};
+        std::uint32_t k[2] = {this->M_key[0], this->M_key[1]};
+        for (int round = 0; round < 10; round++)
+        {
+            std::uint32_t hi0, lo0, hi1, lo1;
+            mulhilo(0xD2511F53u, c[0], hi0, lo0);
+            mulhilo(0xCD9E8D57u, c[2], hi1, lo1);
+            const std::uint32_t n[4] = {hi1 ^ c[1] ^ k[0], lo1, hi0 ^ c[3] ^ k[1], lo0};
+            c[0] = n[0];
+            c[1] = n[1];
+            c[2] = n[2];
+            c[3] = n[3];
+            k[0] += 0x9E3779B9u;
+            k[1] += 0xBB67AE85u;
+        }
+        for (int i = 0; i < 4; i++)
+            this->M_block[i] = c[i];
+
+        // the position is a 64-bit counter, the stream words are never touched
+        if (++this->M_counter[0] == 0)
+            this->M_counter[1]++;
+        this->M_used = 0;
+    }
+
+    rng::result_type rng::operator()()
+    {
+        if (this->M_used == 2)
+            this->refill();
+        const std::size_t i = 2 * this->M_used++;
+        return static_cast<std::uint64_t>(this->M_block[i + 1]) << 32 | this->M_block[i];
+    }
+
+    double rng::uniform()
+    {
+        return static_cast<double>((*this)() >> 11) * 0x1.0p-53;
+    }
+
+    std::uint64_t rng::random_seed()
+    {
+        // std::random_device yields 32 bits per read, one device is read twice
+        static const std::uint64_t process_seed = []
+        {
+            std::random_device device;
+            const std::uint64_t high = device();
+            return high << 32 | device();
+        }();
+        static std::atomic<std::uint64_t> next{0};
+        return rng(process_seed, next.fetch_add(1, std::memory_order_relaxed))();
+    }
+}
@@ -0,0 +1,45 @@
+/**
+ * @file rng.hh
+ * @license This file is licensed under the GNU GENERAL PUBLIC LICENSE Version 3, 29 June 2007. You may obtain a copy of this license at https://www.gnu.org/licenses/gpl-3.0.en.html.
+ * @author Tushar Chaurasia (Dark-CodeX)
+ */
+
+#ifndef SIMULATOR_RNG
+#define SIMULATOR_RNG
+
+#include <cstddef>
+#include <cstdint>
+
+namespace simulator
+{
+    // counter-based generator, Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3", SC'11)
+    // every output block is a keyed bijection of a 128-bit counter, so generators built from the same seed and different `stream`s
+    // are independent and need no shared state: parallel code gives every task its own stream instead of locking one generator
+    // satisfies UniformRandomBitGenerator, the <random> distributions can draw from it
+    class rng
+    {
+      private:
+        std::uint32_t M_key[2];
+        std::uint32_t M_counter[4]; // [0], [1]: position in the stream, [2], [3]: the stream
+        std::uint32_t M_block[4];   // output of the last counter
+        std::size_t M_used;         // 64-bit halves of M_block already handed out
+
+        void refill();
+
+      public:
+        using result_type = std::uint64_t;
+
+        static constexpr result_type min() { return 0; }
+        static constexpr result_type max() { return UINT64_MAX; }
+
+        rng(const std::uint64_t &seed, const std::uint64_t &stream = 0);
+        result_type operator()();
+        // uniform in [0, 1) with 53 random bits
+        double uniform();
+
+        // a fresh seed per call, derived from 64 bits read from std::random_device once per process
+        static std::uint64_t random_seed();
+    };
+}
+
+#endif
@@ -0,0 +1,167 @@
+/**
+ * @file thread_pool.cc
+ * @license This file is licensed under the GNU GENERAL PUBLIC LICENSE Version 3, 29 June 2007. You may obtain a copy of this license at https://www.gnu.org/licenses/gpl-3.0.en.html.
+ * @author Tushar Chaurasia (Dark-CodeX)
+ */
+
+#include "./thread_pool.hh"
+#include <algorithm>
+#include <cstdlib>
+#include <utility>
+
+namespace simulator
+{
+    thread_pool::thread_pool()
+    {
+        std::size_t n = 0;
+        if (const char *env = std::getenv("QUBITVERSE_THREADS"))
+            n = std::strtoul(env, nullptr, 10);
+        this->set_threads(n);
+    }
+
+    thread_pool &thread_pool::instance()
+    {
+        static thread_pool pool;
+        return pool;
+    }
+
+    void thread_pool::stop_workers()
+    {
+        {
+            std::lock_guard<std::mutex> lk(this->M_lock);
+            this->M_stop = true;
+        }
+        this->M_wake.notify_all();
+        for (std::thread &t : this->M_workers)
+            t.join();
+        this->M_workers.clear();
+        this->M_stop = false;
+    }
+
+    void thread_pool::set_threads(std::size_t n)
+    {
+        std::lock_guard<std::mutex> busy(this->M_busy);
+        if (n == 0)
+            n = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+
+        this->stop_workers();
+        this->M_threads = n;
+        for (std::size_t i = 1; i < n; i++)
+            this->M_workers.emplace_back(&thread_pool::worker_loop, this);
+    }
+
+    void thread_pool::set_threshold(const std::size_t &n)
+    {
+        this->M_threshold = n;
+    }
+
+    const std::size_t &thread_pool::get_threads() const
+    {
+        return this->M_threads;
+    }
+
+    const std::size_t &thread_pool::get_threshold() const
+    {
+        return this->M_threshold;
+    }
+
+    // takes the next chunk of the current job, if any, and runs it with M_lock released
+    bool thread_pool::run_chunk(std::unique_lock<std::mutex> &lk)
+    {
+        if (!this->M_job || this->M_next >= this->M_nchunks)
+            return false;
+
+        const std::size_t c = this->M_next++;
+        const range_fn *job = this->M_job;
+        const std::size_t b = this->M_begin + c * this->M_chunk;
+        const std::size_t e = std::min(this->M_end, b + this->M_chunk);
+
+        std::exception_ptr error;
+        lk.unlock();
+        try
+        {
+            (*job)(b, e);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+        lk.lock();
+
+        // the first exception wins, the chunks nobody took yet are dropped so that the caller can rethrow it as soon as the running ones return
+        if (error && !this->M_error)
+        {
+            this->M_error = error;
+            this->M_pending -= this->M_nchunks - this->M_next;
+            this->M_next = this->M_nchunks;
+        }
+        if (--this->M_pending == 0)
+            this->M_done.notify_all();
+        return true;
+    }
+
+    void thread_pool::worker_loop()
+    {
+        std::size_t seen = 0;
+        std::unique_lock<std::mutex> lk(this->M_lock);
+        for (;;)
+        {
+            this->M_wake.wait(lk, [&]
+                              { return this->M_stop || this->M_generation != seen; });
+            if (this->M_stop)
+                return;
+            seen = this->M_generation;
+            while (this->run_chunk(lk))
+                ;
+        }
+    }
+
+    void thread_pool::parallel_for(const std::size_t &begin, const std::size_t &end, const std::size_t &align, const std::size_t &amplitudes, const range_fn &fn)
+    {
+        if (begin >= end)
+            return;
+
+        // len * amplitudes < M_threshold, without the overflow
+        const std::size_t len = end - begin, per = std::max<std::size_t>(1, amplitudes);
+        const bool small = len < this->M_threshold / per + (this->M_threshold % per != 0);
+        // a region already running belongs to another caller (or to this one, from inside a kernel): this range runs serially rather than waiting for it
+        std::unique_lock<std::mutex> busy(this->M_busy, std::try_to_lock);
+        if (this->M_threads < 2 || small || !busy.owns_lock())
+        {
+            fn(begin, end);
+            return;
+        }
+
+        // a few chunks per thread so that uneven progress evens out
+        const std::size_t a = std::max<std::size_t>(1, align);
+        std::size_t chunk = (len + this->M_threads * 4 - 1) / (this->M_threads * 4);
+        chunk = std::max(a, (chunk + a - 1) / a * a);
+
+        std::unique_lock<std::mutex> lk(this->M_lock);
+        this->M_job = &fn;
+        this->M_begin = begin;
+        this->M_end = end;
+        this->M_chunk = chunk;
+        this->M_nchunks = (len + chunk - 1) / chunk;
+        this->M_next = 0;
+        this->M_pending = this->M_nchunks;
+        this->M_generation++;
+        this->M_wake.notify_all();
+
+        while (this->run_chunk(lk))
+            ;
+        this->M_done.wait(lk, [&]
+                          { return this->M_pending == 0; });
+        this->M_job = nullptr;
+        const std::exception_ptr error = std::exchange(this->M_error, nullptr);
+        lk.unlock();
+        busy.unlock();
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    thread_pool::~thread_pool()
+    {
+        this->stop_workers();
+    }
+}
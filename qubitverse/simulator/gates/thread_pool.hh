@@ -0,0 +1,73 @@
+/**
+ * @file thread_pool.hh
+ * @license This file is licensed under the GNU GENERAL PUBLIC LICENSE Version 3, 29 June 2007. You may obtain a copy of this license at https://www.gnu.org/licenses/gpl-3.0.en.html.
+ * @author Tushar Chaurasia (Dark-CodeX)
+ */
+
+#ifndef SIMULATOR_THREAD_POOL
+#define SIMULATOR_THREAD_POOL
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace simulator
+{
+    // fork/join pool shared by every state-vector kernel
+    // the calling thread always takes part in the work, so a pool of N threads spawns N - 1 workers
+    // one parallel region runs at a time: a call made while another thread's region runs (a second request of the server, say) does not wait for the workers,
+    // it runs serially on its own thread, so concurrent requests each keep one core instead of queueing behind each other
+    class thread_pool
+    {
+      public:
+        using range_fn = std::function<void(const std::size_t &, const std::size_t &)>;
+
+      private:
+        std::vector<std::thread> M_workers;
+        std::size_t M_threads = 1;
+        std::size_t M_threshold = static_cast<std::size_t>(1) << 15; // ranges covering fewer amplitudes than this run serially
+
+        // current job, guarded by M_lock
+        std::mutex M_lock;
+        std::condition_variable M_wake, M_done;
+        const range_fn *M_job = nullptr;
+        std::size_t M_begin = 0, M_end = 0, M_chunk = 0, M_nchunks = 0;
+        std::size_t M_next = 0, M_pending = 0, M_generation = 0;
+        std::exception_ptr M_error; // first exception thrown by a chunk of the current job
+        bool M_stop = false;
+
+        // held by the caller whose region is running, see above
+        std::mutex M_busy;
+
+        thread_pool();
+        void worker_loop();
+        bool run_chunk(std::unique_lock<std::mutex> &lk);
+        void stop_workers();
+
+      public:
+        thread_pool(const thread_pool &) = delete;
+        thread_pool &operator=(const thread_pool &) = delete;
+
+        static thread_pool &instance();
+
+        // 0 selects std::thread::hardware_concurrency()
+        void set_threads(std::size_t n);
+        // in amplitudes, whatever the unit of the ranges
+        void set_threshold(const std::size_t &n);
+        const std::size_t &get_threads() const;
+        const std::size_t &get_threshold() const;
+
+        // calls fn(b, e) over disjoint sub-ranges covering [begin, end), every sub-range boundary is a multiple of `align` (relative to `begin`)
+        // each index of the range stands for `amplitudes` amplitudes read or written (2 for a range of pairs, say), which is what the threshold is compared with
+        // if fn throws, the sub-ranges not started yet are skipped and the first exception is rethrown here once the running ones have returned
+        void parallel_for(const std::size_t &begin, const std::size_t &end, const std::size_t &align, const std::size_t &amplitudes, const range_fn &fn);
+
+        ~thread_pool();
+    };
+}
+
+#endif
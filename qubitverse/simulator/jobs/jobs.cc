@@ -0,0 +1,138 @@
+/**
+ * @file jobs.cc
+ * @license This file is licensed under the GNU GENERAL PUBLIC LICENSE Version 3, 29 June 2007. You may obtain a copy of this license at https://www.gnu.org/licenses/gpl-3.0.en.html.
+ * @author Tushar Chaurasia (Dark-CodeX)
+ */
+
+#include "./jobs.hh"
+#include <cstdio>
+
+namespace simulator
+{
+    job_manager::job_manager(const std::size_t &workers, const std::size_t &max_jobs, const std::size_t &ttl_s, const std::size_t &max_retained)
+        : M_max_jobs(max_jobs), M_max_retained(max_retained), M_ttl(ttl_s)
+    {
+        for (std::size_t i = 0; i < workers; i++)
+            this->M_workers.emplace_back(&job_manager::worker_loop, this);
+    }
+
+    void job_manager::worker_loop()
+    {
+        for (;;)
+        {
+            std::shared_ptr<job> j;
+            {
+                std::unique_lock<std::mutex> lk(this->M_lock);
+                this->M_wake.wait(lk, [this]
+                                  { return this->M_stop || !this->M_pending.empty(); });
+                if (this->M_stop)
+                    return;
+                j = std::move(this->M_pending.front());
+                this->M_pending.pop_front();
+                j->M_state = job_state::RUNNING;
+            }
+
+            job_result res = j->M_fn(j->M_progress);
+            // a body that can never fit is not kept at all, the client is told so instead
+            if (res.M_body.size() > this->M_max_retained)
+            {
+                char msg[160];
+                std::snprintf(msg, sizeof(msg), "error: the result of %zu MiB exceeds the %zu MiB kept for finished jobs, run it with ?stream=1 instead\n", res.M_body.size() >> 20, this->M_max_retained >> 20);
+                res = job_result();
+                res.M_status = 507;
+                res.M_body = msg;
+            }
+            auto done = std::make_shared<const job_result>(std::move(res));
+            j->M_fn = nullptr;
+
+            std::lock_guard<std::mutex> guard(this->M_lock);
+            this->purge_expired();
+            while (!this->M_finished.empty() && this->M_retained + done->M_body.size() > this->M_max_retained)
+                this->evict_oldest();
+            this->M_retained += done->M_body.size();
+            j->M_result = std::move(done);
+            j->M_state = job_state::DONE;
+            j->M_expires = std::chrono::steady_clock::now() + this->M_ttl;
+            this->M_finished.push_back(std::move(j));
+        }
+    }
+
+    void job_manager::evict_oldest()
+    {
+        const std::shared_ptr<job> &j = this->M_finished.front();
+        this->M_retained -= j->M_result->M_body.size();
+        this->M_jobs.erase(j->M_id);
+        this->M_finished.pop_front();
+    }
+
+    void job_manager::purge_expired()
+    {
+        const auto now = std::chrono::steady_clock::now();
+        while (!this->M_finished.empty() && this->M_finished.front()->M_expires <= now)
+            this->evict_oldest();
+    }
+
+    bool job_manager::submit(job_fn fn, std::string &id)
+    {
+        {
+            std::lock_guard<std::mutex> guard(this->M_lock);
+            this->purge_expired();
+            if (this->M_jobs.size() >= this->M_max_jobs)
+                return false;
+
+            // 64 random bits (two 32-bit reads of the device), so that the id of someone else's job cannot be guessed
+            char buf[17];
+            do
+            {
+                const unsigned long long hi = this->M_ids(), lo = this->M_ids();
+                std::snprintf(buf, sizeof(buf), "%08llx%08llx", hi & 0xffffffffULL, lo & 0xffffffffULL);
+            } while (this->M_jobs.count(buf));
+            id = buf;
+
+            auto j = std::make_shared<job>();
+            j->M_fn = std::move(fn);
+            j->M_id = id;
+            this->M_jobs.emplace(id, j);
+            this->M_pending.push_back(std::move(j));
+        }
+        this->M_wake.notify_one();
+        return true;
+    }
+
+    bool job_manager::status(const std::string &id, job_status &st)
+    {
+        std::lock_guard<std::mutex> guard(this->M_lock);
+        this->purge_expired();
+        auto it = this->M_jobs.find(id);
+        if (it == this->M_jobs.end())
+            return false;
+        const job &j = *it->second;
+        st = {j.M_state, j.M_progress.M_done.load(std::memory_order_relaxed), j.M_progress.M_total.load(std::memory_order_relaxed)};
+        return true;
+    }
+
+    bool job_manager::result(const std::string &id, job_status &st, std::shared_ptr<const job_result> &res)
+    {
+        std::lock_guard<std::mutex> guard(this->M_lock);
+        this->purge_expired();
+        auto it = this->M_jobs.find(id);
+        if (it == this->M_jobs.end())
+            return false;
+        const job &j = *it->second;
+        st = {j.M_state, j.M_progress.M_done.load(std::memory_order_relaxed), j.M_progress.M_total.load(std::memory_order_relaxed)};
+        if (j.M_state == job_state::DONE)
+            res = j.M_result;
+        return true;
+    }
+
+    job_manager::~job_manager()
+    {
+        {
+            std::lock_guard<std::mutex> guard(this->M_lock);
+            this->M_stop = true;
+        }
+        this->M_wake.notify_all();
+        for (std::thread &t : this->M_workers)
+            t.join();
+    }
+}
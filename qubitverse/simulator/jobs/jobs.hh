@@ -0,0 +1,108 @@
+/**
+ * @file jobs.hh
+ * @license This file is licensed under the GNU GENERAL PUBLIC LICENSE Version 3, 29 June 2007. You may obtain a copy of this license at https://www.gnu.org/licenses/gpl-3.0.en.html.
+ * @author Tushar Chaurasia (Dark-CodeX)
+ */
+
+#ifndef SIMULATOR_JOBS
+#define SIMULATOR_JOBS
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace simulator
+{
+    enum job_state : unsigned char
+    {
+        QUEUED,
+        RUNNING,
+        DONE
+    };
+
+    // updated by the running job, read by the status requests
+    struct job_progress
+    {
+        std::atomic<std::size_t> M_done{0}, M_total{0}; // gates
+    };
+
+    // what the job answers once it is done, in the shape of an HTTP response
+    struct job_result
+    {
+        int M_status = 200;
+        std::vector<std::pair<std::string, std::string>> M_headers;
+        std::string M_content_type = "text/plain";
+        std::string M_body;
+    };
+
+    struct job_status
+    {
+        job_state M_state;
+        std::size_t M_done, M_total;
+    };
+
+    // runs long simulations on its own worker threads, so that no HTTP connection waits for them
+    // results are kept for `ttl_s` seconds after the job finishes, at most `max_jobs` jobs (queued, running or finished) exist at a time
+    // and the finished ones hold at most `max_retained` bytes of bodies, the oldest are dropped first to make room for a new one
+    class job_manager
+    {
+      public:
+        using job_fn = std::function<job_result(job_progress &)>;
+
+      private:
+        struct job
+        {
+            job_state M_state = job_state::QUEUED;
+            job_progress M_progress;
+            std::shared_ptr<const job_result> M_result;
+            job_fn M_fn;
+            std::string M_id;
+            std::chrono::steady_clock::time_point M_expires;
+        };
+
+        std::size_t M_max_jobs, M_max_retained;
+        std::size_t M_retained = 0; // bytes of the bodies of the finished jobs
+        std::chrono::seconds M_ttl;
+        std::unordered_map<std::string, std::shared_ptr<job>> M_jobs;
+        std::deque<std::shared_ptr<job>> M_pending;
+        std::deque<std::shared_ptr<job>> M_finished; // in the order they finished, which is also the order they expire in
+        std::vector<std::thread> M_workers;
+        std::random_device M_ids; // every id is drawn from the device itself, a seeded generator would give the next ids away once one is seen
+        mutable std::mutex M_lock;
+        std::condition_variable M_wake;
+        bool M_stop = false;
+
+        void worker_loop();
+        // expect M_lock to be held
+        void purge_expired();
+        void evict_oldest();
+
+      public:
+        job_manager() = delete;
+        job_manager(const std::size_t &workers, const std::size_t &max_jobs, const std::size_t &ttl_s, const std::size_t &max_retained);
+        job_manager(const job_manager &) = delete;
+        job_manager &operator=(const job_manager &) = delete;
+
+        // `id` receives the identifier of the new job, false when `max_jobs` jobs already exist
+        [[nodiscard]] bool submit(job_fn fn, std::string &id);
+        // false for an unknown or expired `id`
+        [[nodiscard]] bool status(const std::string &id, job_status &st);
+        // false for an unknown or expired `id`, `res` is only set when the job is DONE and shares the body with the job instead of copying it
+        [[nodiscard]] bool result(const std::string &id, job_status &st, std::shared_ptr<const job_result> &res);
+        // lets the running jobs finish, the queued ones are dropped
+        ~job_manager();
+    };
+}
+
+#endif
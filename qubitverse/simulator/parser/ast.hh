@@ -7,17 +7,26 @@
 #ifndef SIMULATOR_AST
 #define SIMULATOR_AST
 
+#include <cmath> // for M_PI
 #include <string>
+#include <vector>
 
 namespace simulator
 {
+    // the angles of the circuit are given in degrees
+    inline double deg_to_rad(const double &deg)
+    {
+        return deg * (M_PI / 180.0);
+    }
+
     enum gate_type : unsigned char
     {
         SINGLE_GATE,
         CNOT_GATE,
         CZ_GATE,
         SWAP_GATE,
-        MEASURE_NTH
+        MEASURE_NTH,
+        CONTROLLED_GATE
     };
 
     class ast_node
@@ -85,6 +94,21 @@ namespace simulator
 
         gate_type get_gate_type() const override { return gate_type::MEASURE_NTH; }
     };
+
+    // single-qubit gate `M_gate` applied on `M_target` only when every qubit of `M_controls` is 1 (Toffoli is X with 2 controls)
+    class ast_controlled_gate_node : public ast_node
+    {
+      public:
+        std::string M_gate;
+        std::vector<std::size_t> M_controls;
+        std::size_t M_target;
+        double M_theta;
+
+        ast_controlled_gate_node(std::string &&_g, std::vector<std::size_t> &&ctrls, const std::size_t &tar, const double &_t)
+            : M_gate(std::move(_g)), M_controls(std::move(ctrls)), M_target(tar), M_theta(_t) {}
+
+        gate_type get_gate_type() const override { return gate_type::CONTROLLED_GATE; }
+    };
 }
 
 #endif
\ No newline at end of file
@@ -5,6 +5,8 @@
  */
 
 #include "./parser.hh"
+#include <algorithm>
+#include <cctype>
 
 namespace simulator
 {
@@ -98,6 +100,35 @@ namespace simulator
                     if (toks[i].M_type == token_type::SEP)
                         i++;
                 }
+                else if (toks[i].M_val == "controlled")
+                {
+                    i++; // skips controlled
+                    std::string g_type;
+                    std::vector<std::size_t> ctrls;
+                    std::size_t tar;
+                    double theta;
+
+                    i += 2; // skips gateType
+                    g_type = toks[i++].M_val;
+                    i += 2; // skips controls
+                    while (i < toks.size() && toks[i].M_type == token_type::IDEN && std::isdigit(static_cast<unsigned char>(toks[i].M_val[0])))
+                        ctrls.push_back(std::stoul(toks[i++].M_val)); // space separated list of control qubits
+                    i += 2; // skips target
+                    tar = std::stoul(toks[i++].M_val);
+                    i += 2; // skips theta
+                    theta = std::stod(toks[i++].M_val);
+                    i += 3; // skips position and its value
+
+                    // checked once here, the fused matrices apply the controls without going through qubit::apply_mcu
+                    std::vector<std::size_t> sorted(ctrls);
+                    std::sort(sorted.begin(), sorted.end());
+                    if (sorted.empty() || std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end() || std::binary_search(sorted.begin(), sorted.end(), tar))
+                        return false;
+
+                    this->M_gatelist.emplace_back(new ast_controlled_gate_node(std::move(g_type), std::move(ctrls), tar, theta));
+                    if (toks[i].M_type == token_type::SEP)
+                        i++;
+                }
                 else
                     return false;
             }
@@ -151,6 +182,16 @@ namespace simulator
                             casted->M_qubit1,
                             casted->M_qubit2);
             }
+            else if (i->get_gate_type() == gate_type::CONTROLLED_GATE)
+            {
+                auto *casted = dynamic_cast<ast_controlled_gate_node *>(i.get());
+                std::printf("CONTROLLED_GATE: [GATE: %s, CONTROLS:", casted->M_gate.c_str());
+                for (const std::size_t &c : casted->M_controls)
+                    std::printf(" %zu", c);
+                std::printf(", TARGET: %zu, THETA: %lf]\n",
+                            casted->M_target,
+                            casted->M_theta);
+            }
         }
     }
 }
\ No newline at end of file
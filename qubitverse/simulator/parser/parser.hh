@@ -22,6 +22,7 @@ namespace simulator
 
       public:
         parser() = default;
+        // false for a malformed circuit, or a controlled gate whose controls are empty, repeated or include its target
         [[nodiscard]] bool perform(std::vector<token> &toks);
         [[nodiscard]] std::vector<std::unique_ptr<ast_node>> &get();
         [[nodiscard]] const std::size_t &get_no_qubits() const;
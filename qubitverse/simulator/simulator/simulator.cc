@@ -5,29 +5,586 @@
  */
 
 #include <iostream>
+#include <cstring>
 #include "../gates/gates.hh"
+#include "../gates/kernels.hh"
+#include "../gates/thread_pool.hh"
 #include "../lexer/lexer.hh"
 #include "../parser/parser.hh"
+#include "../fusion/fusion.hh"
+#include "../admission/admission.hh"
+#include "../jobs/jobs.hh"
+#include "../format/format.hh"
 #include "../dep/httplib.h"
 
-double deg_to_rad(const double &deg)
+// server-wide settings, filled from the command-line in main()
+struct server_config
 {
-    return deg * (M_PI / 180.0);
+    std::size_t fuse_qubits = 0;
+    simulator::state_layout layout = simulator::state_layout::AOS;
+    simulator::state_precision precision = simulator::state_precision::FP64; // default of the requests that do not ask for one
+    std::size_t pool_bytes = static_cast<std::size_t>(1024) << 20;          // idle state-vectors kept for the next requests, capped by the memory budget
+    simulator::pooled_allocator *pool = nullptr;                             // nullptr when pooling is disabled
+    std::size_t max_queue = 4;                                               // requests waiting for memory, kept below httplib's worker count so that other requests are still served
+    std::size_t queue_timeout_ms = 30000;
+    std::size_t job_workers = 2, max_jobs = 64, job_ttl_s = 600; // asynchronous jobs, finished ones are kept for `job_ttl_s` seconds
+    std::size_t job_results_bytes = static_cast<std::size_t>(1024) << 20; // bodies of the finished jobs, outside the memory budget since no state-vector is left
+    simulator::admission_controller *admission = nullptr;
+} config;
+
+// states sent back besides the probabilities and the measurement, serializing 2^n amplitudes per gate dominates mid-size circuits
+enum snapshot_mode : unsigned char
+{
+    SNAPSHOT_ALL,         // the initial state and the state after every gate (after every fused run when fusing)
+    SNAPSHOT_NONE,        // no state at all
+    SNAPSHOT_FINAL,       // the state after the last gate
+    SNAPSHOT_EVERY,       // the initial state, the state after every `M_every`-th gate and after the last one
+    SNAPSHOT_GATES,       // the state after each of the gates `M_gates` (0-based, in circuit order)
+    SNAPSHOT_MEASUREMENTS // the state after every measurement
+};
+
+struct snapshot_policy
+{
+    snapshot_mode M_mode = snapshot_mode::SNAPSHOT_ALL;
+    std::size_t M_every = 1;
+    std::vector<std::size_t> M_gates;
+};
+
+// per-request settings, filled from the query parameters of the request
+struct request_config
+{
+    simulator::state_precision precision = config.precision;
+    bool stream = false; // chunked reply, every snapshot is sent as soon as it is produced
+    snapshot_policy snapshots;
+    simulator::reply_format format = simulator::reply_format::TEXT; // BINARY when the client accepts application/octet-stream
+    int digits = 6;                                                  // significant digits of the text reply, text_writer::shortest for round-trip exact
+    simulator::sparse_filter sparse;                                 // ?epsilon and ?top, leaves out the (near) zero entries of the snapshots and the probabilities
+    std::size_t shots = 0;                                           // ?shots, histogram of that many measurements of the final state
+    std::uint64_t seed = simulator::rng::random_seed();              // ?seed, sent back in X-Seed so that any run can be repeated
+    bool eliminate = false;                                          // ?eliminate=1, qubits measured mid-circuit and never used again are removed from the state-vector, unless snapshots are asked for after that
+};
+
+// a + b and n * size, SIZE_MAX when they overflow
+static std::size_t add_bytes(const std::size_t &a, const std::size_t &b)
+{
+    return a > SIZE_MAX - b ? SIZE_MAX : a + b;
+}
+
+static std::size_t mul_bytes(const std::size_t &n, const std::size_t &size)
+{
+    return size != 0 && n > SIZE_MAX / size ? SIZE_MAX : n * size;
+}
+
+// bytes of the reply to a request sending `snapshots` states: a buffered reply holds all of them, the probabilities, the histogram and the measurement at once,
+// a streamed one only the largest of its chunks; each chunk is written into a scratch string reserved for its longest possible text, which is counted once more
+std::size_t reply_memory(const std::size_t &nQ, const request_config &opts, const char &operation, const std::size_t &snapshots, const std::size_t &hist_entries)
+{
+    const std::size_t len = nQ < static_cast<std::size_t>(std::numeric_limits<std::size_t>::digits) ? std::size_t(1) << nQ : SIZE_MAX;
+    const std::size_t lines = opts.sparse.M_top != 0 ? std::min(opts.sparse.M_top, len) : len;
+    const simulator::text_writer text(opts.digits);
+    const bool binary = opts.format == simulator::reply_format::BINARY;
+
+    // 64 bytes for the label, "prob", "counts" or "measure" line (or frame) of each piece
+    const std::size_t state = add_bytes(64, binary ? simulator::binary_writer::state_bytes(len, lines, opts.precision, opts.sparse) : text.state_bytes(len, lines));
+    const std::size_t probs = operation == '0' ? 0 : add_bytes(64, binary ? simulator::binary_writer::probabilities_bytes(len, lines, opts.precision, opts.sparse) : text.probabilities_bytes(len, lines));
+    const std::size_t counts = opts.shots == 0 ? 0 : add_bytes(64, mul_bytes(hist_entries, binary ? 2 * sizeof(std::uint64_t) : 20 + 1 + 20 + 1));
+    const std::size_t last = add_bytes(add_bytes(probs, counts), operation == '2' ? 64 : 0);
+    const std::size_t chunk = std::max(snapshots != 0 ? state : 0, last);
+    if (opts.stream)
+        return chunk;
+    return add_bytes(add_bytes(mul_bytes(snapshots, state), last), chunk);
+}
+
+// bytes a request holds at its peak: the state-vector, the complex<double> copy get_qubits() makes of it for every storage but AOS in FP64, the probabilities of prob/measure,
+// the histogram of ?shots, which has at most one (state, count) pair per shot or per basis state and is built from per-block pieces (twice that), and the reply
+std::size_t request_memory(const std::size_t &nQ, const request_config &opts, const char &operation, const std::size_t &snapshots)
+{
+    const std::size_t state = simulator::qubit::required_memory(nQ, opts.precision);
+    const std::size_t view = config.layout == simulator::state_layout::SOA || opts.precision == simulator::state_precision::FP32 ? simulator::qubit::required_memory(nQ) : 0;
+    const std::size_t probs = operation == '0' ? 0 : simulator::qubit::required_memory(nQ) / 2;
+    const std::size_t pairs = std::min(opts.shots, simulator::qubit::required_memory(nQ) / sizeof(simulator::qubit::complex));
+    const std::size_t hist = mul_bytes(pairs, 32);
+    return add_bytes(add_bytes(add_bytes(add_bytes(state, view), probs), hist), reply_memory(nQ, opts, operation, snapshots, pairs));
+}
+
+// "double" or "float", returns false for anything else
+bool parse_precision(const std::string &__s, simulator::state_precision &precision)
+{
+    if (__s == "double")
+        precision = simulator::state_precision::FP64;
+    else if (__s == "float")
+        precision = simulator::state_precision::FP32;
+    else
+        return false;
+    return true;
+}
+
+// "all", "none", "final", "measure", "every:K" or "gates:I,J,...", returns false for anything else
+bool parse_snapshots(const std::string &__s, snapshot_policy &policy)
+{
+    if (__s == "all")
+        policy.M_mode = snapshot_mode::SNAPSHOT_ALL;
+    else if (__s == "none")
+        policy.M_mode = snapshot_mode::SNAPSHOT_NONE;
+    else if (__s == "final")
+        policy.M_mode = snapshot_mode::SNAPSHOT_FINAL;
+    else if (__s == "measure")
+        policy.M_mode = snapshot_mode::SNAPSHOT_MEASUREMENTS;
+    else if (__s.starts_with("every:"))
+    {
+        char *end = nullptr;
+        policy.M_mode = snapshot_mode::SNAPSHOT_EVERY;
+        policy.M_every = std::strtoull(__s.c_str() + 6, &end, 10);
+        return policy.M_every != 0 && end != __s.c_str() + 6 && *end == '\0';
+    }
+    else if (__s.starts_with("gates:"))
+    {
+        policy.M_mode = snapshot_mode::SNAPSHOT_GATES;
+        const char *p = __s.c_str() + 6;
+        for (;;)
+        {
+            char *end = nullptr;
+            policy.M_gates.push_back(std::strtoull(p, &end, 10));
+            if (end == p)
+                return false;
+            if (*end == '\0')
+                break;
+            if (*end != ',')
+                return false;
+            p = end + 1;
+        }
+    }
+    else
+        return false;
+    return true;
+}
+
+// fills `opts` from the query parameters, false (with the reason in `error`) for an invalid value
+bool parse_request_config(const httplib::Request &req, request_config &opts, std::string &error)
+{
+    // precision=double|float overrides the server default for this request
+    if (req.has_param("precision") && !parse_precision(req.get_param_value("precision"), opts.precision))
+    {
+        error = "error: precision must be 'double' or 'float'\n";
+        return false;
+    }
+    if (req.has_param("snapshots") && !parse_snapshots(req.get_param_value("snapshots"), opts.snapshots))
+    {
+        error = "error: snapshots must be 'all', 'none', 'final', 'measure', 'every:K' or 'gates:I,J,...'\n";
+        return false;
+    }
+    // digits=N (1-17) or digits=shortest
+    if (req.has_param("digits"))
+    {
+        const std::string digits = req.get_param_value("digits");
+        if (digits == "shortest")
+            opts.digits = simulator::text_writer::shortest;
+        else
+        {
+            char *end = nullptr;
+            opts.digits = static_cast<int>(std::strtol(digits.c_str(), &end, 10));
+            if (digits.empty() || *end != '\0' || opts.digits < 1 || opts.digits > 17)
+            {
+                error = "error: digits must be 'shortest' or a number from 1 to 17\n";
+                return false;
+            }
+        }
+    }
+    // epsilon=E keeps the entries with |amplitude|^2 (or probability) above E, top=K only the K largest of them
+    if (req.has_param("epsilon"))
+    {
+        const std::string epsilon = req.get_param_value("epsilon");
+        char *end = nullptr;
+        opts.sparse.M_epsilon = std::strtod(epsilon.c_str(), &end);
+        if (epsilon.empty() || *end != '\0' || !(opts.sparse.M_epsilon >= 0.0))
+        {
+            error = "error: epsilon must be a non-negative number\n";
+            return false;
+        }
+    }
+    if (req.has_param("top"))
+    {
+        const std::string top = req.get_param_value("top");
+        char *end = nullptr;
+        opts.sparse.M_top = std::strtoull(top.c_str(), &end, 10);
+        if (top.empty() || top[0] == '-' || *end != '\0' || opts.sparse.M_top == 0)
+        {
+            error = "error: top must be a positive integer\n";
+            return false;
+        }
+    }
+    // shots=N samples the final state N times, for the measurement histogram of the visualizer
+    if (req.has_param("shots"))
+    {
+        const std::string shots = req.get_param_value("shots");
+        char *end = nullptr;
+        opts.shots = std::strtoull(shots.c_str(), &end, 10);
+        if (shots.empty() || shots[0] == '-' || *end != '\0' || opts.shots == 0)
+        {
+            error = "error: shots must be a positive integer\n";
+            return false;
+        }
+    }
+    // seed=N makes the measurements and the samples reproducible
+    if (req.has_param("seed"))
+    {
+        const std::string seed = req.get_param_value("seed");
+        char *end = nullptr;
+        opts.seed = std::strtoull(seed.c_str(), &end, 10);
+        if (seed.empty() || seed[0] == '-' || *end != '\0')
+        {
+            error = "error: seed must be a non-negative integer\n";
+            return false;
+        }
+    }
+    opts.stream = req.has_param("stream") && req.get_param_value("stream") == "1";
+    opts.eliminate = req.has_param("eliminate") && req.get_param_value("eliminate") == "1";
+    if (req.get_header_value("Accept").find(simulator::binary_writer::content_type) != std::string::npos)
+        opts.format = simulator::reply_format::BINARY;
+    return true;
+}
+
+// snap[g] is set when the state after gate g is sent back, SNAPSHOT_ALL leaves it empty as every applied gate (or fused run) is sent
+std::vector<bool> snapshot_points(const snapshot_policy &policy, const std::vector<std::unique_ptr<simulator::ast_node>> &gates)
+{
+    std::vector<bool> snap;
+    if (policy.M_mode == snapshot_mode::SNAPSHOT_ALL || policy.M_mode == snapshot_mode::SNAPSHOT_NONE || gates.empty())
+        return snap;
+
+    snap.resize(gates.size(), false);
+    if (policy.M_mode == snapshot_mode::SNAPSHOT_FINAL)
+        snap.back() = true;
+    else if (policy.M_mode == snapshot_mode::SNAPSHOT_EVERY)
+    {
+        for (std::size_t g = policy.M_every - 1; g < gates.size(); g += policy.M_every)
+            snap[g] = true;
+        snap.back() = true;
+    }
+    else if (policy.M_mode == snapshot_mode::SNAPSHOT_GATES)
+    {
+        for (const std::size_t &g : policy.M_gates)
+            if (g < gates.size())
+                snap[g] = true;
+    }
+    else if (policy.M_mode == snapshot_mode::SNAPSHOT_MEASUREMENTS)
+    {
+        for (std::size_t g = 0; g < gates.size(); g++)
+            snap[g] = gates[g]->get_gate_type() == simulator::gate_type::MEASURE_NTH;
+    }
+    return snap;
+}
+
+// false (with the message in `error`) when a gate names a qubit outside a `nQ` qubit-system, which the library would throw on halfway through the reply
+bool check_qubits(const std::size_t &nQ, const std::vector<std::unique_ptr<simulator::ast_node>> &gates, std::string &error)
+{
+    if (nQ < 1)
+    {
+        error = "error: at-least 1 qubit must be present in a valid quantum circuit\n";
+        return false;
+    }
+    for (std::size_t i = 0; i < gates.size(); i++)
+    {
+        std::vector<std::size_t> qubits;
+        switch (gates[i]->get_gate_type())
+        {
+        case simulator::gate_type::SINGLE_GATE:
+            qubits = {static_cast<const simulator::ast_single_gate_node *>(gates[i].get())->M_qubit};
+            break;
+        case simulator::gate_type::CNOT_GATE:
+            qubits = {static_cast<const simulator::ast_cnot_gate_node *>(gates[i].get())->M_control, static_cast<const simulator::ast_cnot_gate_node *>(gates[i].get())->M_target};
+            break;
+        case simulator::gate_type::CZ_GATE:
+            qubits = {static_cast<const simulator::ast_cz_gate_node *>(gates[i].get())->M_control, static_cast<const simulator::ast_cz_gate_node *>(gates[i].get())->M_target};
+            break;
+        case simulator::gate_type::SWAP_GATE:
+            qubits = {static_cast<const simulator::ast_swap_gate_node *>(gates[i].get())->M_qubit1, static_cast<const simulator::ast_swap_gate_node *>(gates[i].get())->M_qubit2};
+            break;
+        case simulator::gate_type::MEASURE_NTH:
+            qubits = {static_cast<const simulator::ast_measure_nth_node *>(gates[i].get())->M_qubit};
+            break;
+        case simulator::gate_type::CONTROLLED_GATE:
+        {
+            const auto *casted = static_cast<const simulator::ast_controlled_gate_node *>(gates[i].get());
+            qubits = casted->M_controls;
+            qubits.push_back(casted->M_target);
+            break;
+        }
+        }
+        for (const std::size_t &q : qubits)
+        {
+            if (q >= nQ)
+            {
+                char msg[128];
+                std::snprintf(msg, sizeof(msg), "error: gate %zu uses qubit %zu, which does not exist in a %zu qubit-system\n", i, q, nQ);
+                error = msg;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// most states sent back for `policy`: SNAPSHOT_ALL sends the initial state and one per gate (fewer when fusing), the terminal measurements send one for all of them
+std::size_t snapshot_count(const snapshot_policy &policy, const std::vector<std::unique_ptr<simulator::ast_node>> &gates)
+{
+    if (policy.M_mode == snapshot_mode::SNAPSHOT_ALL)
+        return gates.size() + 1;
+    if (policy.M_mode == snapshot_mode::SNAPSHOT_NONE)
+        return 0;
+    const std::vector<bool> snap = snapshot_points(policy, gates);
+    const bool initial = policy.M_mode == snapshot_mode::SNAPSHOT_EVERY || (policy.M_mode == snapshot_mode::SNAPSHOT_FINAL && gates.empty());
+    return static_cast<std::size_t>(std::count(snap.begin(), snap.end(), true)) + (initial ? 1 : 0);
+}
+
+// applies a single AST node on `qsys`, returns the label of the snapshot to record, or an empty string if the gate is unknown
+std::string apply_gate(simulator::qubit &qsys, const simulator::ast_node *node)
+{
+    if (node->get_gate_type() == simulator::gate_type::SINGLE_GATE)
+    {
+        auto *casted = dynamic_cast<const simulator::ast_single_gate_node *>(node);
+        if (casted->M_gate == "I")
+        {
+            std::printf("Applying Identity Gate on Qubit %zu:\n", casted->M_qubit);
+            qsys.apply_identity(casted->M_qubit);
+        }
+        else if (casted->M_gate == "X")
+        {
+            std::printf("Applying Pauli-X Gate on Qubit %zu:\n", casted->M_qubit);
+            qsys.apply_pauli_x(casted->M_qubit);
+        }
+        else if (casted->M_gate == "Y")
+        {
+            std::printf("Applying Pauli-Y Gate on Qubit %zu:\n", casted->M_qubit);
+            qsys.apply_pauli_y(casted->M_qubit);
+        }
+        else if (casted->M_gate == "Z")
+        {
+            std::printf("Applying Pauli-Z Gate on Qubit %zu:\n", casted->M_qubit);
+            qsys.apply_pauli_z(casted->M_qubit);
+        }
+        else if (casted->M_gate == "H")
+        {
+            std::printf("Applying Hadamard Gate on Qubit %zu:\n", casted->M_qubit);
+            qsys.apply_hadamard(casted->M_qubit);
+        }
+        else if (casted->M_gate == "S")
+        {
+            std::printf("Applying Phase Shift Gate by pi/2 on Qubit %zu:\n", casted->M_qubit);
+            qsys.apply_phase_pi_2_shift(casted->M_qubit);
+        }
+        else if (casted->M_gate == "T")
+        {
+            std::printf("Applying Phase Shift Gate by pi/4 on Qubit %zu:\n", casted->M_qubit);
+            qsys.apply_phase_pi_4_shift(casted->M_qubit);
+        }
+        else if (casted->M_gate == "P")
+        {
+            std::printf("Applying General Phase Shift Gate by %lf rad on Qubit %zu:\n", simulator::deg_to_rad(casted->M_theta), casted->M_qubit);
+            qsys.apply_phase_general_shift(simulator::deg_to_rad(casted->M_theta), casted->M_qubit);
+        }
+        else if (casted->M_gate == "Rx")
+        {
+            std::printf("Applying Rotation-X Gate by %lf rad on Qubit %zu:\n", simulator::deg_to_rad(casted->M_theta), casted->M_qubit);
+            qsys.apply_rotation_x(simulator::deg_to_rad(casted->M_theta), casted->M_qubit);
+        }
+        else if (casted->M_gate == "Ry")
+        {
+            std::printf("Applying Rotation-Y Gate by %lf rad on Qubit %zu:\n", simulator::deg_to_rad(casted->M_theta), casted->M_qubit);
+            qsys.apply_rotation_y(simulator::deg_to_rad(casted->M_theta), casted->M_qubit);
+        }
+        else if (casted->M_gate == "Rz")
+        {
+            std::printf("Applying Rotation-Z Gate by %lf rad on Qubit %zu:\n", simulator::deg_to_rad(casted->M_theta), casted->M_qubit);
+            qsys.apply_rotation_z(simulator::deg_to_rad(casted->M_theta), casted->M_qubit);
+        }
+        else
+            return "";
+        return casted->M_gate;
+    }
+    else if (node->get_gate_type() == simulator::gate_type::CNOT_GATE)
+    {
+        auto *casted = dynamic_cast<const simulator::ast_cnot_gate_node *>(node);
+        std::printf("Applying CNOT Gate [Control Qubit: %zu, Target Qubit: %zu]:\n", casted->M_control, casted->M_target);
+        qsys.apply_cnot(casted->M_control, casted->M_target);
+        return "cnot";
+    }
+    else if (node->get_gate_type() == simulator::gate_type::CZ_GATE)
+    {
+        auto *casted = dynamic_cast<const simulator::ast_cz_gate_node *>(node);
+        std::printf("Applying CZ Gate [Control Qubit: %zu, Target Qubit: %zu]:\n", casted->M_control, casted->M_target);
+        qsys.apply_cz(casted->M_control, casted->M_target);
+        return "cz";
+    }
+    else if (node->get_gate_type() == simulator::gate_type::SWAP_GATE)
+    {
+        auto *casted = dynamic_cast<const simulator::ast_swap_gate_node *>(node);
+        std::printf("Applying SWAP Gate [Qubit1: %zu, Qubit2: %zu]:\n", casted->M_qubit1, casted->M_qubit2);
+        qsys.apply_swap(casted->M_qubit1, casted->M_qubit2);
+        return "swap";
+    }
+    else if (node->get_gate_type() == simulator::gate_type::CONTROLLED_GATE)
+    {
+        auto *casted = dynamic_cast<const simulator::ast_controlled_gate_node *>(node);
+        simulator::qubit::complex u[2][2];
+        if (!simulator::qubit::get_gate_matrix(u, casted->M_gate, simulator::deg_to_rad(casted->M_theta)))
+            return "";
+
+        std::printf("Applying Controlled-%s Gate [Control Qubits:", casted->M_gate.c_str());
+        for (const std::size_t &c : casted->M_controls)
+            std::printf(" %zu", c);
+        std::printf(", Target Qubit: %zu]:\n", casted->M_target);
+        if (casted->M_gate == "X")
+            qsys.apply_mcx(casted->M_controls, casted->M_target);
+        else if (casted->M_gate == "Z")
+            qsys.apply_mcz(casted->M_controls, casted->M_target);
+        else
+            qsys.apply_mcu(casted->M_controls, u, casted->M_target);
+        return std::string(casted->M_controls.size(), 'c') + casted->M_gate; // ccX for Toffoli
+    }
+    else if (node->get_gate_type() == simulator::gate_type::MEASURE_NTH)
+    {
+        auto *casted = dynamic_cast<const simulator::ast_measure_nth_node *>(node);
+        std::printf("Measuring the Qubit %zu:\n", casted->M_qubit);
+        qsys.measure_nth_qubit(casted->M_qubit);
+        return "measureNth";
+    }
+    return "";
+}
+
+// applies a fused run of gates, the snapshot label lists the names of the fused gates separated by spaces
+std::string apply_fused_gate(simulator::qubit &qsys, const simulator::fused_gate &block)
+{
+    if (block.M_gates.size() == 1)
+        return apply_gate(qsys, block.M_gates.front());
+
+    std::string label;
+    std::printf("Applying %zu Fused Gates on Qubits [", block.M_gates.size());
+    for (std::size_t i = 0; i < block.M_targets.size(); i++)
+        std::printf(i ? ", %zu" : "%zu", block.M_targets[i]);
+    std::puts("]:");
+    for (const simulator::ast_node *node : block.M_gates)
+    {
+        if (!label.empty())
+            label.push_back(' ');
+        if (node->get_gate_type() == simulator::gate_type::SINGLE_GATE)
+            label.append(dynamic_cast<const simulator::ast_single_gate_node *>(node)->M_gate);
+        else if (node->get_gate_type() == simulator::gate_type::CNOT_GATE)
+            label.append("cnot");
+        else if (node->get_gate_type() == simulator::gate_type::CZ_GATE)
+            label.append("cz");
+        else if (node->get_gate_type() == simulator::gate_type::SWAP_GATE)
+            label.append("swap");
+        else if (node->get_gate_type() == simulator::gate_type::CONTROLLED_GATE)
+        {
+            auto *casted = dynamic_cast<const simulator::ast_controlled_gate_node *>(node);
+            label.append(std::string(casted->M_controls.size(), 'c') + casted->M_gate);
+        }
+    }
+    qsys.apply_matrix(block.M_targets, block.M_matrix);
+    return label;
 }
 
-void set_quantum_states(const simulator::qubit &q, std::string &__s, const std::string &gate)
+// calls fn on every qubit index of `node`, which fn may rewrite
+template <typename Fn>
+void for_each_qubit(simulator::ast_node *node, Fn &&fn)
 {
-    const simulator::qubit::complex *vec_space = q.get_qubits();
-    std::stringstream ss;
-    ss << gate << "\n";
-    for (std::size_t i = 0; i < q.get_size(); i++)
+    if (node->get_gate_type() == simulator::gate_type::SINGLE_GATE)
+        fn(dynamic_cast<simulator::ast_single_gate_node *>(node)->M_qubit);
+    else if (node->get_gate_type() == simulator::gate_type::CNOT_GATE)
+    {
+        auto *casted = dynamic_cast<simulator::ast_cnot_gate_node *>(node);
+        fn(casted->M_control);
+        fn(casted->M_target);
+    }
+    else if (node->get_gate_type() == simulator::gate_type::CZ_GATE)
+    {
+        auto *casted = dynamic_cast<simulator::ast_cz_gate_node *>(node);
+        fn(casted->M_control);
+        fn(casted->M_target);
+    }
+    else if (node->get_gate_type() == simulator::gate_type::SWAP_GATE)
+    {
+        auto *casted = dynamic_cast<simulator::ast_swap_gate_node *>(node);
+        fn(casted->M_qubit1);
+        fn(casted->M_qubit2);
+    }
+    else if (node->get_gate_type() == simulator::gate_type::MEASURE_NTH)
+        fn(dynamic_cast<simulator::ast_measure_nth_node *>(node)->M_qubit);
+    else if (node->get_gate_type() == simulator::gate_type::CONTROLLED_GATE)
     {
-        ss << i << "=" << vec_space[i] << "\n";
+        auto *casted = dynamic_cast<simulator::ast_controlled_gate_node *>(node);
+        for (std::size_t &c : casted->M_controls)
+            fn(c);
+        fn(casted->M_target);
     }
-    __s.append(ss.str());
 }
 
-std::string get_quantum_info(const std::size_t &nQ, const std::vector<std::unique_ptr<simulator::ast_node>> &gates, const char &operation)
+std::unique_ptr<simulator::ast_node> clone_gate(const simulator::ast_node *node)
+{
+    switch (node->get_gate_type())
+    {
+    case simulator::gate_type::SINGLE_GATE:
+        return std::make_unique<simulator::ast_single_gate_node>(*dynamic_cast<const simulator::ast_single_gate_node *>(node));
+    case simulator::gate_type::CNOT_GATE:
+        return std::make_unique<simulator::ast_cnot_gate_node>(*dynamic_cast<const simulator::ast_cnot_gate_node *>(node));
+    case simulator::gate_type::CZ_GATE:
+        return std::make_unique<simulator::ast_cz_gate_node>(*dynamic_cast<const simulator::ast_cz_gate_node *>(node));
+    case simulator::gate_type::SWAP_GATE:
+        return std::make_unique<simulator::ast_swap_gate_node>(*dynamic_cast<const simulator::ast_swap_gate_node *>(node));
+    case simulator::gate_type::MEASURE_NTH:
+        return std::make_unique<simulator::ast_measure_nth_node>(*dynamic_cast<const simulator::ast_measure_nth_node *>(node));
+    case simulator::gate_type::CONTROLLED_GATE:
+        return std::make_unique<simulator::ast_controlled_gate_node>(*dynamic_cast<const simulator::ast_controlled_gate_node *>(node));
+    }
+    return nullptr;
+}
+
+// ?eliminate=1: a measurement before the terminal ones whose qubit no later gate touches removes that qubit from the state-vector, which halves the work of every later gate
+// the memory of the removed half only goes back to the system with the huge-page allocator: pooled and heap buffers keep it (see state_allocator::discard)
+// returns a copy of the circuit where every qubit index is shifted down past the qubits removed before it, removes[g] is the qubit measurement g removes, SIZE_MAX for none
+std::vector<std::unique_ptr<simulator::ast_node>> eliminate_measured(const std::size_t &nQ, const std::vector<std::unique_ptr<simulator::ast_node>> &gates, const std::size_t &terminal, std::vector<std::size_t> &removes)
+{
+    // invalid qubits are kept as they are, for the gates to report
+    std::vector<std::size_t> last(nQ, SIZE_MAX); // last gate touching each qubit
+    for (std::size_t g = 0; g < gates.size(); g++)
+        for_each_qubit(gates[g].get(), [&](const std::size_t &q)
+                       {
+                           if (q < nQ)
+                               last[q] = g;
+                       });
+
+    std::vector<std::unique_ptr<simulator::ast_node>> circuit;
+    std::vector<std::size_t> removed; // ascending
+    removes.assign(gates.size(), SIZE_MAX);
+    for (std::size_t g = 0; g < gates.size(); g++)
+    {
+        circuit.push_back(clone_gate(gates[g].get()));
+        for_each_qubit(circuit.back().get(), [&](std::size_t &q)
+                       {
+                           if (q < nQ)
+                               q -= static_cast<std::size_t>(std::lower_bound(removed.begin(), removed.end(), q) - removed.begin());
+                       });
+        if (g >= terminal || gates[g]->get_gate_type() != simulator::gate_type::MEASURE_NTH)
+            continue;
+        const std::size_t q = dynamic_cast<const simulator::ast_measure_nth_node *>(gates[g].get())->M_qubit;
+        if (q < nQ && last[q] == g && removed.size() + 1 < nQ)
+        {
+            removes[g] = q;
+            removed.insert(std::lower_bound(removed.begin(), removed.end(), q), q);
+        }
+    }
+    return circuit;
+}
+
+// receives the reply piece by piece: the initial state, one snapshot per gate, then the probabilities and the measurement
+// the pieces are only as large as one snapshot, so a streamed reply never holds more than O(2^n) characters
+// returning false (the client went away) stops the simulation
+using reply_sink = std::function<bool(const std::string &)>;
+
+// `norm_drift` receives |1 - sum of |amplitude|^2| after the last gate, the rounding error accumulated by the circuit
+// `progress`, when given, counts the gates applied so far
+// returns false when `emit` did
+bool get_quantum_info(const std::size_t &nQ, const std::vector<std::unique_ptr<simulator::ast_node>> &gates, const char &operation, const request_config &opts, double &norm_drift, const reply_sink &emit, simulator::job_progress *progress = nullptr)
 {
     /*
     operation:
@@ -35,173 +592,545 @@ std::string get_quantum_info(const std::size_t &nQ, const std::vector<std::uniqu
     1 -> prob (0, 1)
     2 -> measure (0, 1, 2)
     */
-    simulator::qubit qsys(nQ);
-    std::string ret_val;
+    simulator::qubit qsys(nQ, config.layout, opts.precision);
+    qsys.seed(opts.seed);
+    std::string chunk;
+    std::printf("State-vector of %zu bytes allocated with policy: %s\n", qsys.memory_consumption(), qsys.allocation_policy());
+    if (config.pool)
+        std::printf("State-vector pool: %zu hit(s), %zu miss(es), %zu MiB idle\n", config.pool->hits(), config.pool->misses(), config.pool->retained() >> 20);
 
-    std::puts("System is on initial state:");
-    set_quantum_states(qsys, ret_val, "+"); // + indicates initial state
-    for (const std::unique_ptr<simulator::ast_node> &i : gates)
+    // consecutive gates on at most `config.fuse_qubits` qubits are applied as one matrix, 0 applies every gate on its own
+    // runs are also cut after every snapshot point, the gates in between are still fused
+    const snapshot_mode &mode = opts.snapshots.M_mode;
+    const std::vector<bool> snap = snapshot_points(opts.snapshots, gates);
+
+    // the measurements that end the circuit are handled after the loop: ?shots samples the state before them, then they collapse it (at once when no state between them is sent back)
+    std::size_t terminal = gates.size();
+    while (terminal > 0 && gates[terminal - 1]->get_gate_type() == simulator::gate_type::MEASURE_NTH)
+        terminal--;
+    std::vector<std::size_t> measured;
+    for (std::size_t g = terminal; g < gates.size(); g++)
+        measured.push_back(dynamic_cast<const simulator::ast_measure_nth_node *>(gates[g].get())->M_qubit);
+
+    // with ?eliminate=1 the gates run on the qubit indices of the shrinking state-vector
+    std::vector<std::size_t> removes;
+    std::vector<std::unique_ptr<simulator::ast_node>> remapped;
+    bool eliminate = opts.eliminate;
+    if (eliminate)
     {
-        if (i->get_gate_type() == simulator::gate_type::SINGLE_GATE)
+        remapped = eliminate_measured(nQ, gates, terminal, removes);
+        // a snapshot sees the whole system: one due while qubits are out would put them back and take them out again, two more passes than removing them saves
+        // (every gate asks for one by default), so the circuit then runs as it is
+        const std::size_t first = static_cast<std::size_t>(std::find_if(removes.begin(), removes.end(), [](const std::size_t &q)
+                                                                        { return q != SIZE_MAX; }) -
+                                                           removes.begin());
+        for (std::size_t g = first; g + 1 < terminal && eliminate; g++)
+            eliminate = !(mode == snapshot_mode::SNAPSHOT_ALL || (!snap.empty() && snap[g]));
+        if (!eliminate)
         {
-            auto *casted = dynamic_cast<simulator::ast_single_gate_node *>(i.get());
-            if (casted->M_gate == "I")
-            {
-                std::printf("Applying Identity Gate on Qubit %zu:\n", casted->M_qubit);
-                qsys.apply_identity(casted->M_qubit);
-                set_quantum_states(qsys, ret_val, casted->M_gate);
-            }
-            else if (casted->M_gate == "X")
-            {
-                std::printf("Applying Pauli-X Gate on Qubit %zu:\n", casted->M_qubit);
-                qsys.apply_pauli_x(casted->M_qubit);
-                set_quantum_states(qsys, ret_val, casted->M_gate);
-            }
-            else if (casted->M_gate == "Y")
-            {
-                std::printf("Applying Pauli-Y Gate on Qubit %zu:\n", casted->M_qubit);
-                qsys.apply_pauli_y(casted->M_qubit);
-                set_quantum_states(qsys, ret_val, casted->M_gate);
-            }
-            else if (casted->M_gate == "Z")
-            {
-                std::printf("Applying Pauli-Z Gate on Qubit %zu:\n", casted->M_qubit);
-                qsys.apply_pauli_z(casted->M_qubit);
-                set_quantum_states(qsys, ret_val, casted->M_gate);
-            }
-            else if (casted->M_gate == "H")
-            {
-                std::printf("Applying Hadamard Gate on Qubit %zu:\n", casted->M_qubit);
-                qsys.apply_hadamard(casted->M_qubit);
-                set_quantum_states(qsys, ret_val, casted->M_gate);
-            }
-            else if (casted->M_gate == "S")
-            {
-                std::printf("Applying Phase Shift Gate by pi/2 on Qubit %zu:\n", casted->M_qubit);
-                qsys.apply_phase_pi_2_shift(casted->M_qubit);
-                set_quantum_states(qsys, ret_val, casted->M_gate);
-            }
-            else if (casted->M_gate == "T")
-            {
-                std::printf("Applying Phase Shift Gate by pi/4 on Qubit %zu:\n", casted->M_qubit);
-                qsys.apply_phase_pi_4_shift(casted->M_qubit);
-                set_quantum_states(qsys, ret_val, casted->M_gate);
-            }
-            else if (casted->M_gate == "P")
-            {
-                std::printf("Applying General Phase Shift Gate by %lf rad on Qubit %zu:\n", deg_to_rad(casted->M_theta), casted->M_qubit);
-                qsys.apply_phase_general_shift(deg_to_rad(casted->M_theta), casted->M_qubit);
-                set_quantum_states(qsys, ret_val, casted->M_gate);
-            }
-            else if (casted->M_gate == "Rx")
-            {
-                std::printf("Applying Rotation-X Gate by %lf rad on Qubit %zu:\n", deg_to_rad(casted->M_theta), casted->M_qubit);
-                qsys.apply_rotation_x(deg_to_rad(casted->M_theta), casted->M_qubit);
-                set_quantum_states(qsys, ret_val, casted->M_gate);
-            }
-            else if (casted->M_gate == "Ry")
-            {
-                std::printf("Applying Rotation-Y Gate by %lf rad on Qubit %zu:\n", deg_to_rad(casted->M_theta), casted->M_qubit);
-                qsys.apply_rotation_y(deg_to_rad(casted->M_theta), casted->M_qubit);
-                set_quantum_states(qsys, ret_val, casted->M_gate);
-            }
-            else if (casted->M_gate == "Rz")
-            {
-                std::printf("Applying Rotation-Z Gate by %lf rad on Qubit %zu:\n", deg_to_rad(casted->M_theta), casted->M_qubit);
-                qsys.apply_rotation_z(deg_to_rad(casted->M_theta), casted->M_qubit);
-                set_quantum_states(qsys, ret_val, casted->M_gate);
-            }
+            std::puts("Not removing measured qubits, snapshots are sent back while they would be out");
+            removes.clear();
         }
-        else if (i->get_gate_type() == simulator::gate_type::CNOT_GATE)
+    }
+    const std::vector<std::unique_ptr<simulator::ast_node>> &circuit = eliminate ? remapped : gates;
+
+    // qubits removed so far as (qubit, measured outcome), ascending
+    // they are put back, in that basis state, before the last snapshot, the terminal measurements and the outputs, which all see the whole system
+    std::vector<std::pair<std::size_t, std::size_t>> removed;
+    auto restore = [&]()
+    {
+        for (std::size_t r = 0; r < removed.size(); r++)
+            qsys.insert_qubit(removed[r].first, removed[r].second);
+        removed.clear();
+    };
+
+    simulator::fusion fuser(config.fuse_qubits);
+    fuser.perform(circuit, snap);
+
+    const bool binary = opts.format == simulator::reply_format::BINARY;
+    const simulator::text_writer text(opts.digits);
+    auto write_state = [&](const std::string &label)
+    {
+        if (binary)
+            simulator::binary_writer::state(chunk, label, qsys, opts.sparse);
+        else
+            text.state(chunk, label, qsys, opts.sparse);
+    };
+
+    // the header goes out with the first chunk
+    if (binary)
+        simulator::binary_writer::header(chunk, nQ);
+    else
+        text.header(chunk, nQ, opts.sparse);
+    std::puts("System is on initial state:");
+    if (mode == snapshot_mode::SNAPSHOT_ALL || mode == snapshot_mode::SNAPSHOT_EVERY || (mode == snapshot_mode::SNAPSHOT_FINAL && gates.empty()))
+        write_state("+"); // + indicates initial state
+    if (!chunk.empty() && !emit(chunk))
+        return false;
+
+    // a snapshot is labelled with the names of all the gates applied since the previous one, or "measureNth" when it follows a measurement
+    std::string label;
+    std::size_t applied = 0;
+    for (const simulator::fused_gate &i : fuser.get())
+    {
+        if (applied >= terminal)
+            break; // measurements are never fused, the runs end exactly there
+        std::string name;
+        if (!removes.empty() && removes[applied] != SIZE_MAX)
         {
-            auto *casted = dynamic_cast<simulator::ast_cnot_gate_node *>(i.get());
-            std::printf("Applying CNOT Gate [Control Qubit: %zu, Target Qubit: %zu]:\n", casted->M_control, casted->M_target);
-            qsys.apply_cnot(casted->M_control, casted->M_target);
-            set_quantum_states(qsys, ret_val, "cnot");
+            // measurements are never fused, the run is this measurement alone
+            const std::size_t q = dynamic_cast<const simulator::ast_measure_nth_node *>(i.M_gates.front())->M_qubit;
+            std::printf("Measuring the Qubit %zu and removing it from the state-vector:\n", removes[applied]);
+            const std::size_t outcome = qsys.measure_nth_qubit(q) == 1;
+            qsys.remove_qubit(q, outcome);
+            removed.insert(std::lower_bound(removed.begin(), removed.end(), std::make_pair(removes[applied], outcome)), {removes[applied], outcome});
+            name = "measureNth";
         }
-        else if (i->get_gate_type() == simulator::gate_type::CZ_GATE)
+        else
+            name = apply_fused_gate(qsys, i);
+        applied += i.M_gates.size();
+        if (progress)
+            progress->M_done.fetch_add(i.M_gates.size(), std::memory_order_relaxed);
+        if (name == "measureNth" || label.empty() || label == "measureNth")
+            label = name;
+        else if (!name.empty())
+            label.append(" " + name);
+
+        if (label.empty() || !(mode == snapshot_mode::SNAPSHOT_ALL || (!snap.empty() && snap[applied - 1])))
+            continue;
+        chunk.clear();
+        restore(); // no qubit is out unless this is the state before the terminal measurements, see above
+        write_state(label);
+        if (!emit(chunk))
+            return false;
+        label.clear();
+    }
+    restore();
+
+    simulator::qubit::histogram counts;
+    if (!measured.empty())
+    {
+        if (opts.shots != 0)
         {
-            auto *casted = dynamic_cast<simulator::ast_cz_gate_node *>(i.get());
-            std::printf("Applying CZ Gate [Control Qubit: %zu, Target Qubit: %zu]:\n", casted->M_control, casted->M_target);
-            qsys.apply_cz(casted->M_control, casted->M_target);
-            set_quantum_states(qsys, ret_val, "cz");
+            std::printf("Sampling %zu shots of the %zu measured qubit(s):\n", opts.shots, measured.size());
+            counts = qsys.sample(opts.shots, measured);
         }
-        else if (i->get_gate_type() == simulator::gate_type::SWAP_GATE)
+
+        // the reply keeps one "measureNth" snapshot per measurement asked for: when the state between two of them is wanted (always, by default) they are applied one by one
+        bool at_once = mode != snapshot_mode::SNAPSHOT_ALL;
+        for (std::size_t g = terminal; g + 1 < gates.size() && !snap.empty(); g++)
+            at_once = at_once && !snap[g];
+        if (at_once)
         {
-            auto *casted = dynamic_cast<simulator::ast_swap_gate_node *>(i.get());
-            std::printf("Applying SWAP Gate [Qubit1: %zu, Qubit2: %zu]:\n", casted->M_qubit1, casted->M_qubit2);
-            qsys.apply_swap(casted->M_qubit1, casted->M_qubit2);
-            set_quantum_states(qsys, ret_val, "swap");
+            std::printf("Measuring the Qubits");
+            for (const std::size_t &q : measured)
+                std::printf(" %zu", q);
+            std::puts(" at once:");
+            qsys.measure_qubits(measured);
+            if (progress)
+                progress->M_done.fetch_add(measured.size(), std::memory_order_relaxed);
         }
-        else if(i->get_gate_type() == simulator::gate_type::MEASURE_NTH)
+        for (std::size_t g = terminal; g < gates.size(); g++)
         {
-            auto *casted = dynamic_cast<simulator::ast_measure_nth_node *>(i.get());
-            std::printf("Measuring the Qubit %zu:\n", casted->M_qubit);
-            qsys.measure_nth_qubit(casted->M_qubit);
-            set_quantum_states(qsys, ret_val, "measureNth");
+            if (!at_once)
+            {
+                std::printf("Measuring the Qubit %zu:\n", measured[g - terminal]);
+                qsys.measure_nth_qubit(measured[g - terminal]);
+                if (progress)
+                    progress->M_done.fetch_add(1, std::memory_order_relaxed);
+            }
+            else if (g + 1 < gates.size())
+                continue;
+            if (mode != snapshot_mode::SNAPSHOT_ALL && (snap.empty() || !snap[g]))
+                continue;
+            chunk.clear();
+            write_state("measureNth");
+            if (!emit(chunk))
+                return false;
         }
     }
+    norm_drift = std::abs(1.0 - qsys.total_probability());
+    std::printf("Norm drift in %s precision: %.3e\n", opts.precision == simulator::state_precision::FP32 ? "single" : "double", norm_drift);
+
+    // the histogram is drawn before measure() collapses the state
+    if (opts.shots != 0 && measured.empty())
+    {
+        std::printf("Sampling %zu shots:\n", opts.shots);
+        counts = qsys.sample(opts.shots);
+    }
+    auto write_counts = [&]()
+    {
+        if (opts.shots == 0)
+            return;
+        if (binary)
+            simulator::binary_writer::counts(chunk, counts);
+        else
+            text.counts(chunk, counts);
+    };
 
-    if (operation == '0')
-        return ret_val;
-    else if (operation == '1')
+    if (operation == '1' || operation == '2')
     {
-        ret_val.append("prob\n");
-        double *vec_prob = new double[qsys.get_size()]();
+        std::vector<double> probs(qsys.get_size());
+        double *vec_prob = probs.data();
         std::puts("Computing Probabilities:");
         qsys.compute_probabilities(vec_prob);
 
-        std::stringstream ss;
-        for (std::size_t i = 0; i < qsys.get_size(); i++)
+        chunk.clear();
+        if (binary)
+            simulator::binary_writer::probabilities(chunk, vec_prob, qsys.get_size(), opts.precision, opts.sparse);
+        else
+            text.probabilities(chunk, vec_prob, qsys.get_size(), opts.sparse);
+        write_counts();
+
+        if (operation == '2')
         {
-            ss << i << "=" << vec_prob[i] << "\n";
+            std::puts("Measuring the states:");
+            const std::size_t outcome = qsys.measure();
+            if (binary)
+                simulator::binary_writer::measurement(chunk, outcome);
+            else
+                text.measurement(chunk, outcome);
         }
-        ret_val.append(ss.str());
-        return ret_val;
+        return emit(chunk);
     }
-    else if (operation == '2')
+    chunk.clear();
+    write_counts();
+    return chunk.empty() || emit(chunk);
+}
+
+// a request body ("<operation><circuit>") that was parsed and admitted, it holds its share of the memory budget until destroyed
+struct prepared_request
+{
+    char M_feature;
+    simulator::lexer M_lex;
+    simulator::parser M_parser;
+    std::size_t M_required;
+    simulator::admission_controller::ticket M_ticket;
+};
+
+// parses `body` and waits for its memory, false (with the error response in `result`) when it cannot run
+bool prepare(const std::string &body, const request_config &opts, prepared_request &req, simulator::job_result &result, simulator::job_progress *progress = nullptr)
+{
+    result.M_headers.emplace_back("Access-Control-Allow-Origin", "https://qubitverse.vercel.app");
+    result.M_headers.emplace_back("Vary", "Accept");
+
+    req.M_feature = body[0];
+    if (!req.M_lex.perform(body.substr(1)) || !req.M_parser.perform(req.M_lex.get()))
     {
-        ret_val.append("prob\n");
-        double *vec_prob = new double[qsys.get_size()]();
-        std::puts("Computing Probabilities:");
-        qsys.compute_probabilities(vec_prob);
+        const char *msg = "error: malformed circuit, or a controlled gate whose controls are empty, repeated or include its target\n";
+        std::fputs(msg, stderr);
+        result.M_status = 400;
+        result.M_body = msg;
+        return false;
+    }
+    req.M_parser.debug_print();
+    if (progress)
+        progress->M_total.store(req.M_parser.get().size(), std::memory_order_relaxed);
 
-        std::stringstream ss;
-        for (std::size_t i = 0; i < qsys.get_size(); i++)
-        {
-            ss << i << "=" << vec_prob[i] << "\n";
-        }
+    std::string error;
+    if (!check_qubits(req.M_parser.get_no_qubits(), req.M_parser.get(), error))
+    {
+        std::fputs(error.c_str(), stderr);
+        result.M_status = 400;
+        result.M_body = error;
+        return false;
+    }
+
+    // a request over the whole budget can never run, the qubit constructor would throw
+    const std::size_t snapshots = snapshot_count(opts.snapshots, req.M_parser.get());
+    req.M_required = request_memory(req.M_parser.get_no_qubits(), opts, req.M_feature, snapshots);
+    if (req.M_required > simulator::qubit::get_memory_budget())
+    {
+        char msg[256];
+        std::snprintf(msg, sizeof(msg), "error: a %zu qubit-system needs %zu MiB, which exceeds the memory budget of %zu MiB\n", req.M_parser.get_no_qubits(), req.M_required >> 20, simulator::qubit::get_memory_budget() >> 20);
+        // the snapshots of a buffered reply are what usually tips it over
+        if (!opts.stream && snapshots > 1 && request_memory(req.M_parser.get_no_qubits(), opts, req.M_feature, 1) <= simulator::qubit::get_memory_budget())
+            std::snprintf(msg, sizeof(msg), "error: the reply of %zu snapshots of a %zu qubit-system needs %zu MiB, which exceeds the memory budget of %zu MiB, ask for fewer snapshots or stream the reply with ?stream=1\n", snapshots, req.M_parser.get_no_qubits(), req.M_required >> 20, simulator::qubit::get_memory_budget() >> 20);
+        std::fputs(msg, stderr);
+        result.M_status = 413;
+        result.M_body = msg;
+        return false;
+    }
+
+    // otherwise it waits until the requests already running leave enough of the budget
+    const simulator::admission_status status = config.admission->acquire(req.M_required, req.M_ticket);
+    if (status != simulator::admission_status::ADMITTED)
+    {
+        const char *msg = status == simulator::admission_status::QUEUE_FULL ? "error: too many requests are waiting for memory, try again later\n" : "error: timed out waiting for memory, try again later\n";
+        std::fputs(msg, stderr);
+        result.M_status = status == simulator::admission_status::QUEUE_FULL ? 429 : 503;
+        result.M_headers.emplace_back("Access-Control-Expose-Headers", "Retry-After");
+        result.M_headers.emplace_back("Retry-After", std::to_string(config.admission->retry_after()));
+        result.M_body = msg;
+        return false;
+    }
+    std::printf("Admitted after waiting %.3f ms for %zu MiB\n", req.M_ticket.wait_ms(), req.M_required >> 20);
+    return true;
+}
 
-        std::puts("Measuring the states:");
-        ss << "measure\n"
-           << qsys.measure() << "\n";
+// runs one request body, shared by /api/endpoint and the asynchronous jobs
+simulator::job_result simulate(const std::string &body, const request_config &opts, simulator::job_progress *progress = nullptr)
+{
+    simulator::job_result result;
+    prepared_request req;
+    if (!prepare(body, opts, req, result, progress))
+        return result;
 
-        ret_val.append(ss.str());
-        return ret_val;
+    double norm_drift = 0.0;
+    result.M_content_type = opts.format == simulator::reply_format::BINARY ? simulator::binary_writer::content_type : "text/plain";
+    // prepare() rejects what the library throws on, this only keeps a job worker alive should something slip through
+    try
+    {
+        get_quantum_info(req.M_parser.get_no_qubits(), req.M_parser.get(), req.M_feature, opts, norm_drift, [&result](const std::string &chunk)
+                         { result.M_body.append(chunk);
+                           return true; }, progress);
+    }
+    catch (const std::exception &e)
+    {
+        std::fprintf(stderr, "error: %s\n", e.what());
+        result.M_status = 500;
+        result.M_content_type = "text/plain";
+        result.M_body = std::string("error: ") + e.what() + "\n";
+        return result;
     }
+
+    char drift[32], wait[32];
+    std::snprintf(drift, sizeof(drift), "%.3e", norm_drift);
+    std::snprintf(wait, sizeof(wait), "%.3f", req.M_ticket.wait_ms());
+    result.M_headers.emplace_back("Access-Control-Expose-Headers", "X-Precision, X-Seed, X-Norm-Drift, X-Queue-Wait");
+    result.M_headers.emplace_back("X-Precision", opts.precision == simulator::state_precision::FP32 ? "float" : "double");
+    result.M_headers.emplace_back("X-Seed", std::to_string(opts.seed));
+    result.M_headers.emplace_back("X-Norm-Drift", drift);
+    result.M_headers.emplace_back("X-Queue-Wait", wait);
+    return result;
 }
 
-int main(void)
+int main(int argc, char **argv)
 {
+    std::size_t budget = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            simulator::thread_pool::instance().set_threads(std::strtoul(argv[++i], nullptr, 10));
+        else if (std::strcmp(argv[i], "--parallel-threshold") == 0 && i + 1 < argc)
+            simulator::thread_pool::instance().set_threshold(std::strtoul(argv[++i], nullptr, 10));
+        else if (std::strcmp(argv[i], "--fuse") == 0 && i + 1 < argc)
+            config.fuse_qubits = std::min<std::size_t>(std::strtoul(argv[++i], nullptr, 10), simulator::fusion::max_fused_qubits);
+        else if (std::strcmp(argv[i], "--precision") == 0 && i + 1 < argc && parse_precision(argv[i + 1], config.precision))
+            i++;
+        else if (std::strcmp(argv[i], "--memory-budget") == 0 && i + 1 < argc && simulator::state_allocator::parse_mib(argv[i + 1], budget) && budget != 0)
+        {
+            simulator::qubit::set_memory_budget(budget);
+            i++;
+        }
+        else if (std::strcmp(argv[i], "--layout") == 0 && i + 1 < argc && (std::strcmp(argv[i + 1], "aos") == 0 || std::strcmp(argv[i + 1], "soa") == 0))
+            config.layout = std::strcmp(argv[++i], "soa") == 0 ? simulator::state_layout::SOA : simulator::state_layout::AOS;
+        else if (std::strcmp(argv[i], "--alloc") == 0 && i + 1 < argc && simulator::state_allocator::from_name(argv[i + 1]))
+            simulator::state_allocator::set_default(*simulator::state_allocator::from_name(argv[++i]));
+        else if (std::strcmp(argv[i], "--pool-size") == 0 && i + 1 < argc && simulator::state_allocator::parse_mib(argv[i + 1], config.pool_bytes))
+            i++;
+        else if (std::strcmp(argv[i], "--max-queue") == 0 && i + 1 < argc)
+            config.max_queue = std::strtoull(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--queue-timeout") == 0 && i + 1 < argc)
+            config.queue_timeout_ms = std::strtoull(argv[++i], nullptr, 10) * 1000;
+        else if (std::strcmp(argv[i], "--job-workers") == 0 && i + 1 < argc)
+            config.job_workers = std::max<std::size_t>(1, std::strtoull(argv[++i], nullptr, 10));
+        else if (std::strcmp(argv[i], "--max-jobs") == 0 && i + 1 < argc)
+            config.max_jobs = std::strtoull(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--job-ttl") == 0 && i + 1 < argc)
+            config.job_ttl_s = std::strtoull(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--job-results") == 0 && i + 1 < argc && simulator::state_allocator::parse_mib(argv[i + 1], config.job_results_bytes))
+            i++;
+        else
+        {
+            std::fprintf(stderr, "usage: %s [--threads N] [--parallel-threshold AMPLITUDES] [--fuse K (0-5)] [--layout aos|soa] [--precision double|float] [--memory-budget MIB (> 0)] [--alloc hugepages|aligned] [--pool-size MIB (0 disables)] [--max-queue N] [--queue-timeout SECONDS] [--job-workers N] [--max-jobs N] [--job-ttl SECONDS] [--job-results MIB]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    std::printf("Using %s gate kernels on the %s state-vector layout\n", simulator::kernels::active_isa(), config.layout == simulator::state_layout::SOA ? "soa" : "aos");
+    std::printf("Simulating in %s precision unless a request asks for another one\n", config.precision == simulator::state_precision::FP32 ? "single" : "double");
+    std::printf("State-vectors are limited to %zu MiB\n", simulator::qubit::get_memory_budget() >> 20);
+    std::printf("Allocating state-vectors with the %s allocator\n", simulator::state_allocator::get_default().name());
+
+    // released state-vectors stay mapped (and faulted in) for the next request of the same size instead of going back to the OS
+    simulator::pooled_allocator pool(simulator::state_allocator::get_default(), std::min(config.pool_bytes, simulator::qubit::get_memory_budget()));
+    if (config.pool_bytes)
+    {
+        config.pool = &pool;
+        simulator::state_allocator::set_default(pool);
+        std::printf("Keeping up to %zu MiB of released state-vectors for reuse\n", std::min(config.pool_bytes, simulator::qubit::get_memory_budget()) >> 20);
+    }
+    std::printf("Using %zu thread(s) for state-vectors of at least %zu amplitudes\n", simulator::thread_pool::instance().get_threads(), simulator::thread_pool::instance().get_threshold());
+    if (config.fuse_qubits)
+        std::printf("Fusing consecutive gates into unitaries on up to %zu qubit(s)\n", config.fuse_qubits);
+
+    // requests run concurrently as long as their memory fits in the budget, the others wait in line or are turned away
+    static simulator::admission_controller admission(simulator::qubit::get_memory_budget(), config.max_queue, config.queue_timeout_ms);
+    config.admission = &admission;
+    // idle pooled buffers count against the budget too: they are handed back to the system when an admitted request would not fit next to them
+    if (config.pool)
+        admission.set_reclaim([&pool]
+                              { return pool.retained(); },
+                              [&pool]
+                              { pool.trim(); });
+    std::printf("Queueing up to %zu request(s) for at most %zu s when the memory budget is exhausted\n", config.max_queue, config.queue_timeout_ms / 1000);
+
+    // long simulations can be submitted as jobs, which run on these workers instead of the HTTP threads
+    static simulator::job_manager jobs(config.job_workers, config.max_jobs, config.job_ttl_s, config.job_results_bytes);
+    std::printf("Running up to %zu job(s) at a time, results are kept for %zu s, at most %zu MiB of them\n", config.job_workers, config.job_ttl_s, config.job_results_bytes >> 20);
+
     httplib::Server svr;
+    svr.Get("/api/stats", [](const httplib::Request &, httplib::Response &res)
+            {
+                const simulator::admission_stats st = config.admission->stats();
+                char body[512];
+                std::snprintf(body, sizeof(body),
+                              "memory_budget=%zu\nmemory_in_use=%zu\nrunning=%zu\nqueued=%zu\nadmitted=%zu\nrejected=%zu\ntimed_out=%zu\nmean_wait_ms=%.3f\nmax_wait_ms=%.3f\n",
+                              st.M_budget, st.M_in_use, st.M_running, st.M_queued, st.M_admitted, st.M_rejected, st.M_timed_out, st.M_mean_wait_ms, st.M_max_wait_ms);
+                res.set_header("Access-Control-Allow-Origin", "https://qubitverse.vercel.app");
+                res.set_content(body, "text/plain"); });
+
     svr.Post("/api/endpoint", [](const httplib::Request &req, httplib::Response &res)
              {
-                char feature = req.body[0];
-                simulator::lexer lex;
-                lex.perform(req.body.substr(1));
+                request_config opts;
+                std::string error;
+                if (!parse_request_config(req, opts, error))
+                {
+                    res.status = 400;
+                    res.set_header("Access-Control-Allow-Origin", "https://qubitverse.vercel.app");
+                    res.set_content(error, "text/plain");
+                    return;
+                }
 
-                simulator::parser parser;
-                parser.perform(lex.get());
-                parser.debug_print();
+                if (opts.stream)
+                {
+                    // errors are still answered with a status, only an admitted request switches to chunked transfer
+                    auto prepared = std::make_shared<prepared_request>();
+                    simulator::job_result result;
+                    if (!prepare(req.body, opts, *prepared, result))
+                    {
+                        res.status = result.M_status;
+                        for (const auto &[key, value] : result.M_headers)
+                            res.set_header(key, value);
+                        res.set_content(result.M_body, result.M_content_type);
+                        return;
+                    }
+                    for (const auto &[key, value] : result.M_headers)
+                        res.set_header(key, value);
+                    // the norm drift is only known after the last gate, it is sent as a trailer; the wait for memory is over once prepare() returns
+                    char wait[32];
+                    std::snprintf(wait, sizeof(wait), "%.3f", prepared->M_ticket.wait_ms());
+                    res.set_header("Access-Control-Expose-Headers", "X-Precision, X-Seed, X-Norm-Drift, X-Queue-Wait");
+                    res.set_header("X-Precision", opts.precision == simulator::state_precision::FP32 ? "float" : "double");
+                    res.set_header("X-Seed", std::to_string(opts.seed));
+                    res.set_header("X-Queue-Wait", wait);
+                    res.set_header("Trailer", "X-Norm-Drift");
+                    res.set_chunked_content_provider(opts.format == simulator::reply_format::BINARY ? simulator::binary_writer::content_type : "text/plain", [prepared, opts](std::size_t, httplib::DataSink &sink)
+                                                     {
+                                                        double norm_drift = 0.0;
+                                                        // the status is gone with the first chunk, an exception can only abort the stream (the client sees it end without the trailer)
+                                                        try
+                                                        {
+                                                            if (!get_quantum_info(prepared->M_parser.get_no_qubits(), prepared->M_parser.get(), prepared->M_feature, opts, norm_drift, [&sink](const std::string &chunk)
+                                                                                  { return sink.write(chunk.data(), chunk.size()); }))
+                                                            {
+                                                                std::puts("Client disconnected, simulation stopped");
+                                                                return false;
+                                                            }
+                                                        }
+                                                        catch (const std::exception &e)
+                                                        {
+                                                            std::fprintf(stderr, "error: %s, stream aborted\n", e.what());
+                                                            return false;
+                                                        }
+                                                        char drift[32];
+                                                        std::snprintf(drift, sizeof(drift), "%.3e", norm_drift);
+                                                        sink.done_with_trailer({{"X-Norm-Drift", drift}});
+                                                        std::puts("---------------------------------------------------------------------");
+                                                        return true; });
+                    return;
+                }
 
-                std::string reply = get_quantum_info(parser.get_no_qubits(), parser.get(), feature);
+                const simulator::job_result result = simulate(req.body, opts);
+                res.status = result.M_status;
+                for (const auto &[key, value] : result.M_headers)
+                    res.set_header(key, value);
+                res.set_content(result.M_body, result.M_content_type);
+                std::puts("---------------------------------------------------------------------"); });
 
-                // Set CORS header
+    // same body and query parameters as /api/endpoint (?stream is ignored), answers 202 with the id of the job
+    svr.Post("/api/jobs", [](const httplib::Request &req, httplib::Response &res)
+             {
                 res.set_header("Access-Control-Allow-Origin", "https://qubitverse.vercel.app");
+                request_config opts;
+                std::string error;
+                if (!parse_request_config(req, opts, error))
+                {
+                    res.status = 400;
+                    res.set_content(error, "text/plain");
+                    return;
+                }
 
-                // Set the response content as plain text
-                res.set_content(reply, "text/plain");
-                std::puts("---------------------------------------------------------------------"); });
+                std::string id;
+                const std::string body = req.body;
+                if (!jobs.submit([body, opts](simulator::job_progress &progress)
+                                 {
+                                     simulator::job_result result = simulate(body, opts, &progress);
+                                     std::puts("---------------------------------------------------------------------");
+                                     return result; },
+                                 id))
+                {
+                    res.status = 429;
+                    res.set_header("Access-Control-Expose-Headers", "Retry-After");
+                    res.set_header("Retry-After", std::to_string(config.admission->retry_after()));
+                    res.set_content("error: too many jobs, fetch the finished ones or try again later\n", "text/plain");
+                    return;
+                }
+                std::printf("Submitted job %s\n", id.c_str());
+                res.status = 202;
+                res.set_header("Access-Control-Expose-Headers", "Location");
+                res.set_header("Location", "/api/jobs/" + id);
+                res.set_content(id + "\n", "text/plain"); });
+
+    // state=queued|running|done and the number of gates applied so far
+    svr.Get("/api/jobs/:id", [](const httplib::Request &req, httplib::Response &res)
+            {
+                res.set_header("Access-Control-Allow-Origin", "https://qubitverse.vercel.app");
+                simulator::job_status st;
+                if (!jobs.status(req.path_params.at("id"), st))
+                {
+                    res.status = 404;
+                    res.set_content("error: no such job, it may have expired\n", "text/plain");
+                    return;
+                }
+                const char *state = st.M_state == simulator::job_state::QUEUED ? "queued" : st.M_state == simulator::job_state::RUNNING ? "running" : "done";
+                res.set_content("state=" + std::string(state) + "\ngates_done=" + std::to_string(st.M_done) + "\ngates_total=" + std::to_string(st.M_total) + "\n", "text/plain"); });
+
+    // the response /api/endpoint would have given, 202 while the job is not done yet
+    svr.Get("/api/jobs/:id/result", [](const httplib::Request &req, httplib::Response &res)
+            {
+                simulator::job_status st;
+                std::shared_ptr<const simulator::job_result> result;
+                if (!jobs.result(req.path_params.at("id"), st, result))
+                {
+                    res.status = 404;
+                    res.set_header("Access-Control-Allow-Origin", "https://qubitverse.vercel.app");
+                    res.set_content("error: no such job, it may have expired\n", "text/plain");
+                    return;
+                }
+                if (st.M_state != simulator::job_state::DONE)
+                {
+                    res.status = 202;
+                    res.set_header("Access-Control-Allow-Origin", "https://qubitverse.vercel.app");
+                    res.set_content("gates_done=" + std::to_string(st.M_done) + "\ngates_total=" + std::to_string(st.M_total) + "\n", "text/plain");
+                    return;
+                }
+                res.status = result->M_status;
+                for (const auto &[key, value] : result->M_headers)
+                    res.set_header(key, value);
+                // written straight from the body the job keeps, which stays alive until the provider is released even when the job expires meanwhile
+                res.set_content_provider(result->M_body.size(), result->M_content_type, [result](std::size_t offset, std::size_t length, httplib::DataSink &sink)
+                                         { return sink.write(result->M_body.data() + offset, length); }); });
 
     // Start the server on port 9080
     svr.listen("0.0.0.0", 9080);
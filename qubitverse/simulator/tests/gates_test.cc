@@ -0,0 +1,178 @@
+/**
+ * @file gates_test.cc
+ * @license This file is licensed under the GNU GENERAL PUBLIC LICENSE Version 3, 29 June 2007. You may obtain a copy of this license at https://www.gnu.org/licenses/gpl-3.0.en.html.
+ * @author Tushar Chaurasia (Dark-CodeX)
+ */
+
+#include "../gates/gates.hh"
+#include "../gates/thread_pool.hh"
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+
+static int failures = 0;
+
+static void expect(const bool &ok, const char *what)
+{
+    if (!ok)
+    {
+        std::fprintf(stderr, "FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+// true when `fn` throws `E`, anything else (including not throwing at all) is a failure
+template <typename E, typename Fn>
+static bool throws(Fn &&fn)
+{
+    try
+    {
+        fn();
+    }
+    catch (const E &)
+    {
+        return true;
+    }
+    catch (...)
+    {
+    }
+    return false;
+}
+
+static void test_required_memory()
+{
+    using simulator::qubit;
+    using simulator::state_precision;
+
+    expect(qubit::required_memory(1) == 32, "1 qubit needs 2 complex<double>");
+    expect(qubit::required_memory(31) == std::size_t(1) << 35, "31 qubits need 32 GiB");
+    expect(qubit::required_memory(32) == std::size_t(1) << 36, "32 qubits need 64 GiB");
+    expect(qubit::required_memory(32, state_precision::FP32) == std::size_t(1) << 35, "32 qubits in FP32 need 32 GiB");
+
+    // the largest sizes that still fit a std::size_t, then the first ones that do not
+    expect(qubit::required_memory(59) == std::size_t(1) << 63, "59 qubits need 2^63 bytes");
+    expect(qubit::required_memory(60) == SIZE_MAX, "60 qubits overflow in FP64");
+    expect(qubit::required_memory(60, state_precision::FP32) == std::size_t(1) << 63, "60 qubits need 2^63 bytes in FP32");
+    expect(qubit::required_memory(61, state_precision::FP32) == SIZE_MAX, "61 qubits overflow in FP32");
+    expect(qubit::required_memory(64) == SIZE_MAX, "64 qubits overflow");
+    expect(qubit::required_memory(SIZE_MAX) == SIZE_MAX, "SIZE_MAX qubits overflow");
+}
+
+static void test_parse_mib()
+{
+    using simulator::state_allocator;
+
+    std::size_t bytes = 7;
+    expect(state_allocator::parse_mib("0", bytes) && bytes == 0, "0 MiB parses");
+    expect(state_allocator::parse_mib("1024", bytes) && bytes == std::size_t(1) << 30, "1024 MiB is 1 GiB");
+    expect(state_allocator::parse_mib("17592186044416", bytes) && bytes == SIZE_MAX, "2^44 MiB saturates");
+    expect(state_allocator::parse_mib("99999999999999999999999", bytes) && bytes == SIZE_MAX, "out of range saturates");
+    bytes = 7;
+    for (const char *bad : {"", "abc", "12abc", " 12", "-1", "+1", "1.5"})
+        expect(!state_allocator::parse_mib(bad, bytes), "non-numbers are refused");
+    expect(bytes == 7, "a refused value leaves the output untouched");
+}
+
+static void test_construction()
+{
+    using simulator::qubit;
+
+    expect(throws<std::invalid_argument>([]
+                                         { qubit q(0); }),
+           "a 0 qubit-system is refused");
+
+    // refused before anything is allocated, so these are safe on any machine
+    const std::size_t budget = qubit::get_memory_budget();
+    qubit::set_memory_budget(std::size_t(1) << 20);
+    expect(throws<std::length_error>([]
+                                     { qubit q(31); }),
+           "31 qubits exceed a 1 MiB budget");
+    expect(throws<std::length_error>([]
+                                     { qubit q(32); }),
+           "32 qubits exceed a 1 MiB budget");
+    expect(throws<std::length_error>([]
+                                     { qubit q(64); }),
+           "64 qubits exceed any budget");
+    qubit::set_memory_budget(budget);
+}
+
+// indices at and past the 32-bit boundary must be refused, not shifted into a valid one
+static void test_indices()
+{
+    using simulator::qubit;
+
+    qubit q(3);
+    for (const std::size_t idx : {std::size_t(3), std::size_t(31), std::size_t(32), std::size_t(63), std::size_t(64), SIZE_MAX})
+    {
+        char what[96];
+        std::snprintf(what, sizeof(what), "qubit %zu is refused by a 3 qubit-system", idx);
+        expect(throws<std::out_of_range>([&]
+                                         { q.apply_hadamard(idx); }),
+               what);
+        expect(throws<std::out_of_range>([&]
+                                         { q.apply_rotation_x(1.0, idx); }),
+               what);
+        expect(throws<std::out_of_range>([&]
+                                         { q.apply_cnot(0, idx); }),
+               what);
+        expect(throws<std::out_of_range>([&]
+                                         { q.apply_swap(idx, 1); }),
+               what);
+        expect(throws<std::out_of_range>([&]
+                                         { q.apply_mcx({0, 1}, idx); }),
+               what);
+        expect(throws<std::invalid_argument>([&]
+                                             { q.apply_mcz({idx}, 0); }),
+               what);
+        expect(throws<std::invalid_argument>([&]
+                                             { q.apply_matrix({idx}, {1, 0, 0, 1}); }),
+               what);
+        expect(throws<std::out_of_range>([&]
+                                         { q.measure_nth_qubit(idx); }),
+               what);
+    }
+
+    // a refused gate leaves the state as it was
+    expect(std::abs(q.get_qubits()[0] - qubit::complex(1, 0)) < 1e-12, "the state is untouched by refused gates");
+    q.apply_hadamard(2);
+    expect(std::abs(q.get_qubits()[4] - qubit::complex(M_SQRT1_2, 0)) < 1e-12, "valid indices still apply");
+}
+
+// an exception thrown by one chunk reaches the caller, and the pool still runs the next region
+static void test_thread_pool()
+{
+    simulator::thread_pool &pool = simulator::thread_pool::instance();
+    const std::size_t threads = pool.get_threads(), threshold = pool.get_threshold();
+    pool.set_threads(4);
+    pool.set_threshold(1);
+
+    expect(throws<std::runtime_error>([&]
+                                      { pool.parallel_for(0, 1024, 1, 1, [](const std::size_t &b, const std::size_t &)
+                                                          {
+                                                              if (b == 0)
+                                                                  throw std::runtime_error("chunk");
+                                                          }); }),
+           "a throwing chunk is rethrown on the calling thread");
+
+    std::atomic<std::size_t> sum = 0;
+    pool.parallel_for(0, 1024, 1, 1, [&](const std::size_t &b, const std::size_t &e)
+                      { sum += e - b; });
+    expect(sum == 1024, "the pool covers the whole range after an exception");
+
+    pool.set_threshold(threshold);
+    pool.set_threads(threads);
+}
+
+int main()
+{
+    test_required_memory();
+    test_parse_mib();
+    test_construction();
+    test_indices();
+    test_thread_pool();
+    if (failures)
+        std::fprintf(stderr, "%d check(s) failed\n", failures);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
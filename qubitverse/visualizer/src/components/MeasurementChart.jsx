@@ -3,12 +3,12 @@ import { BarChart, Bar, XAxis, YAxis, Tooltip, CartesianGrid, ResponsiveContaine
 
 function array_to_freq_table(a) {
     const data = new Map();
-    a.forEach(i => { data.set(i, (data.get(i) || 0) + 1); });
+    a.forEach(i => { data.set(i.val, (data.get(i.val) || 0) + i.freq); });
     return Array.from(data, ([val, freq]) => ({ val, freq }));
 }
 
 export default function MeasurementChart({ hist }) {
-    // hist is a list of numbers, we need to convert it into freq. table that means how much an item has occurred in the list
+    // hist is a list of { val, freq } entries (freq is 1 for a single measurement, the count for ?shots), we need to convert it into freq. table that means how much an item has occurred in total
     const [activeIndex, setActiveIndex] = useState(null);
     const freqTable = array_to_freq_table(hist);
     return (
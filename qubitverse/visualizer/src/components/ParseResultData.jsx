@@ -2,15 +2,26 @@ const ParseValueLine = (line) => {
     return line.split("=");
 }
 
-const ParseQubitData = (lines, startIndex) => {
+const QubitLabel = (i) => {
+    return i + ": |" + i.toString(2) + "〉\t";
+}
+
+// a sparse reply (numStates > 0) only lists some of the basis states, the missing ones are 0
+const ParseQubitData = (lines, startIndex, numStates = 0) => {
     let vals = [];
+    for (let k = 0; k < numStates; k++)
+        vals.push({ qubit: QubitLabel(k), value: "(0,0)" });
     let i = startIndex;
     while (/^[ a-z]+$/i.test(lines[i]) === false && lines[i] !== "") {
         const tup = ParseValueLine(lines[i]);
-        vals.push({
+        const entry = {
             qubit: tup[0] + ": |" + Number(tup[0]).toString(2) + "〉\t",
             value: tup[1]
-        });
+        };
+        if (numStates > 0)
+            vals[Number(tup[0])] = entry;
+        else
+            vals.push(entry);
         i++;
     }
     return { values: vals, newIndex: i };
@@ -21,13 +32,107 @@ const ParseProbData = (lines, i) => {
     return { name: tup[0], value: Number(tup[1]) };
 }
 
+const VertexLabel = (label) => {
+    if (label === "+")
+        return "Initial State";
+    if (label === "measureNth")
+        return "Measuring the Qubit";
+    return "Applying " + label.toUpperCase() + " Gate";
+}
+
+// decodes the application/octet-stream reply of the simulator (see simulator/format/format.hh)
+// header: "QVB1", u32 qubits; frames: u8 kind, u8 bytes per real, u16, u32 label length, u64 count, label and data each padded to 8 bytes
+// sparse frames (kinds 4 and 5) carry `count` u64 indices before the data and are expanded here to the dense kinds 1 and 2
+// the counts frame (kind 6) carries `count` u64 basis states, then their `count` u64 counts
+export const DecodeBinaryResult = (buffer) => {
+    const view = new DataView(buffer);
+    const magic = String.fromCharCode(view.getUint8(0), view.getUint8(1), view.getUint8(2), view.getUint8(3));
+    if (magic !== "QVB1")
+        throw new Error("not a qubitverse binary reply");
+    const pad = (n) => (n + 7) & ~7;
+    const frames = [];
+    const numStates = 2 ** view.getUint32(4, true);
+    let off = 8;
+    while (off + 16 <= buffer.byteLength) {
+        const kind = view.getUint8(off), realSize = view.getUint8(off + 1);
+        const labelLen = view.getUint32(off + 4, true), count = Number(view.getBigUint64(off + 8, true));
+        off += 16;
+        const label = new TextDecoder().decode(new Uint8Array(buffer, off, labelLen));
+        off += pad(labelLen);
+        if (kind === 3) {
+            frames.push({ kind: kind, label: label, outcome: Number(view.getBigUint64(off, true)) });
+            off += 8;
+            continue;
+        }
+        if (kind === 6) {
+            const counts = [];
+            for (let k = 0; k < count; k++)
+                counts.push({ val: Number(view.getBigUint64(off + 8 * k, true)), freq: Number(view.getBigUint64(off + 8 * (count + k), true)) });
+            frames.push({ kind: kind, label: label, counts: counts });
+            off += 16 * count;
+            continue;
+        }
+        let indices = null;
+        if (kind === 4 || kind === 5) {
+            indices = [];
+            for (let k = 0; k < count; k++)
+                indices.push(Number(view.getBigUint64(off + 8 * k, true)));
+            off += 8 * count;
+        }
+        const width = kind === 1 || kind === 4 ? 2 : 1;
+        const n = width * count;
+        let values = realSize === 4 ? new Float32Array(buffer, off, n) : new Float64Array(buffer, off, n);
+        off += pad(n * realSize);
+        if (indices) {
+            const dense = new Float64Array(width * numStates);
+            for (let k = 0; k < count; k++)
+                for (let w = 0; w < width; w++)
+                    dense[width * indices[k] + w] = values[width * k + w];
+            values = dense;
+        }
+        frames.push({ kind: width === 2 ? 1 : 2, label: label, values: values });
+    }
+    return { numQubits: view.getUint32(4, true), frames: frames };
+}
+
 export const ParseResultData = ({ data, setProbData, setEdgesResultGraph, setVerticesResultGraph, setMeasuredValue, setMeasurementHist }) => {
-    var vertices = [], edges = [], measured = NaN, prob = [], isMeasureSystem = false;
-    const lines = data.split('\n');
+    var vertices = [], edges = [], measured = NaN, prob = [], isMeasureSystem = false, numStates = 0, counts = [];
+    const lines = data instanceof ArrayBuffer ? [] : data.split('\n');
+
+    if (data instanceof ArrayBuffer) {
+        for (const frame of DecodeBinaryResult(data).frames) {
+            if (frame.kind === 1) {
+                const values = [];
+                for (let k = 0; k < frame.values.length / 2; k++)
+                    values.push({ qubit: QubitLabel(k), value: "(" + frame.values[2 * k] + "," + frame.values[2 * k + 1] + ")" });
+                vertices.push({
+                    id: vertices.length + 1,
+                    label: VertexLabel(frame.label),
+                    originalLabel: VertexLabel(frame.label),
+                    expanded: false,
+                    values: values
+                });
+            }
+            else if (frame.kind === 2) {
+                for (let k = 0; k < frame.values.length; k++)
+                    prob.push({ name: String(k), value: frame.values[k] });
+            }
+            else if (frame.kind === 3) {
+                measured = frame.outcome;
+                isMeasureSystem = true;
+            }
+            else if (frame.kind === 6) {
+                counts = frame.counts;
+            }
+        }
+    }
 
     for (let i = 0, j = 0; i < lines.length; i++) {
-        if (lines[i] === "+") {
-            const { values, newIndex } = ParseQubitData(lines, i + 1); // start after the "+" marker if needed
+        if (lines[i].startsWith("qubits=")) {
+            numStates = 2 ** Number(lines[i].slice(7)); // sparse reply
+        }
+        else if (lines[i] === "+") {
+            const { values, newIndex } = ParseQubitData(lines, i + 1, numStates); // start after the "+" marker if needed
             vertices.push({
                 id: j + 1,
                 label: "Initial State",
@@ -39,7 +144,7 @@ export const ParseResultData = ({ data, setProbData, setEdgesResultGraph, setVer
             j++;
         }
         else if (lines[i] === "measureNth") {
-            const { values, newIndex } = ParseQubitData(lines, i + 1);
+            const { values, newIndex } = ParseQubitData(lines, i + 1, numStates);
             vertices.push({
                 id: j + 1,
                 label: "Measuring the Qubit",
@@ -52,8 +157,23 @@ export const ParseResultData = ({ data, setProbData, setEdgesResultGraph, setVer
         }
         else if (lines[i] === "prob") {
             i++; // skip prob
+            for (let k = 0; k < numStates; k++)
+                prob.push({ name: String(k), value: 0 });
             while (/^[ a-z]+$/i.test(lines[i]) === false && lines[i] !== "") {
-                prob.push(ParseProbData(lines, i));
+                const p = ParseProbData(lines, i);
+                if (numStates > 0)
+                    prob[Number(p.name)] = p;
+                else
+                    prob.push(p);
+                i++;
+            }
+            i--;
+        }
+        else if (lines[i] === "counts") {
+            i++; // skip counts
+            while (/^[ a-z]+$/i.test(lines[i]) === false && lines[i] !== "") {
+                const [val, freq] = lines[i].split("=");
+                counts.push({ val: Number(val), freq: Number(freq) });
                 i++;
             }
             i--;
@@ -65,7 +185,7 @@ export const ParseResultData = ({ data, setProbData, setEdgesResultGraph, setVer
         }
         else {
             if (lines[i] === "") continue;
-            const { values, newIndex } = ParseQubitData(lines, i + 1); // start after the "+" marker if needed
+            const { values, newIndex } = ParseQubitData(lines, i + 1, numStates); // start after the "+" marker if needed
             vertices.push({
                 id: j + 1,
                 label: "Applying " + lines[i].toUpperCase() + " Gate",
@@ -85,10 +205,11 @@ export const ParseResultData = ({ data, setProbData, setEdgesResultGraph, setVer
         }
         prob[measured].value = 1;
 
-        let measuredValueVertex = JSON.parse(JSON.stringify(vertices[0].values)); // deep copy
-        for (let i = 0; i < measuredValueVertex.length; i++) {
-            measuredValueVertex[i].value = "(0,0)";
-        }
+        // the basis states are taken from the probabilities, the reply may carry no state snapshot at all (?snapshots=none)
+        let measuredValueVertex = prob.map((p) => ({
+            qubit: QubitLabel(Number(p.name)),
+            value: "(0,0)"
+        }));
         measuredValueVertex[measured].value = "(1,0)";
 
         vertices.push({
@@ -99,8 +220,11 @@ export const ParseResultData = ({ data, setProbData, setEdgesResultGraph, setVer
             values: measuredValueVertex
         });
 
-        setMeasurementHist(prev => [...prev, measured]);
+        setMeasurementHist(prev => [...prev, { val: measured, freq: 1 }]);
     }
+    // ?shots=N, the whole histogram comes in one reply
+    if (counts.length > 0)
+        setMeasurementHist(prev => [...prev, ...counts]);
 
     for (let i = 0; i < vertices.length - 1; i++) {
         edges.push({ from: i + 1, to: i + 2 });
@@ -2,7 +2,7 @@ import { Button } from "@/components/ui/button";
 import ParseResultData from "./ParseResultData";
 
 // This function extracts circuit data from the gates state
-function extractCircuitData(gates, cnotGates, czGates, swapGates, measureNthQ, nQ) {
+function extractCircuitData(gates, cnotGates, czGates, swapGates, measureNthQ, nQ, controlledGates = []) {
     // Process single-qubit gates
     const processedGates = gates.map((gate) => {
         // Calculate which qubit this gate is on based on y position
@@ -56,8 +56,20 @@ function extractCircuitData(gates, cnotGates, czGates, swapGates, measureNthQ, n
         }
     });
 
+    // Process multi-controlled gates (Toffoli is gateType "X" with two controls)
+    const processedControlledGates = controlledGates.map((gate) => {
+        return {
+            type: "controlled",
+            gateType: gate.gateType,
+            controls: gate.controls.join(" "), // the lexer only accepts space separated lists
+            target: gate.target,
+            theta: Object.hasOwn(gate, "theta") === false ? -1 : gate.theta,
+            position: gate.x,
+        };
+    });
+
     // Combine all gates and sort by position (x coordinate)
-    const allGates = [...processedGates, ...processedCnotGates, ...processedCZGates, ...processedSwapGates, ...measureNthQubits].sort(
+    const allGates = [...processedGates, ...processedCnotGates, ...processedCZGates, ...processedSwapGates, ...measureNthQubits, ...processedControlledGates].sort(
         (a, b) => a.position - b.position
     );
 
@@ -81,17 +93,33 @@ function quantum_encode(cktData, feature) {
     return s;
 }
 
-export function SendToBackEnd_Calculate({ gates, cnotGates, czGates, swapGates, measureNthQ, numQubits, setLog, setProbData, setEdgesResultGraph, setVerticesResultGraph, setMeasuredValue, setMeasurementHist, funcAddQubits, funcRemoveQubits }) {
-    const request_backend = async (dat) => {
+export function SendToBackEnd_Calculate({ gates, cnotGates, czGates, swapGates, measureNthQ, controlledGates = [], numQubits, setLog, setProbData, setEdgesResultGraph, setVerticesResultGraph, setMeasuredValue, setMeasurementHist, funcAddQubits, funcRemoveQubits }) {
+    // the reply is streamed: the log shows every snapshot as soon as it arrives, the result graphs are parsed once it is complete
+    const request_backend = async (dat, query = "") => {
         try {
-            const response = await fetch('https://20.2.90.168:9080/api/endpoint', {
+            const response = await fetch('https://20.2.90.168:9080/api/endpoint?stream=1' + query, {
                 method: 'POST',
                 headers: {
                     'Content-Type': 'text/plain',
                 },
                 body: dat
             });
-            return await response.text();
+            // binary replies (Accept: application/octet-stream) are handed to ParseResultData as an ArrayBuffer
+            if (response.headers.get('Content-Type') === 'application/octet-stream')
+                return await response.arrayBuffer();
+            if (!response.body)
+                return await response.text();
+            const reader = response.body.getReader();
+            const decoder = new TextDecoder();
+            let text = "";
+            for (;;) {
+                const { done, value } = await reader.read();
+                if (done)
+                    break;
+                text += decoder.decode(value, { stream: true });
+                setLog(text);
+            }
+            return text + decoder.decode();
         } catch (error) {
             console.error('Error:', error);
             return null;
@@ -100,7 +128,7 @@ export function SendToBackEnd_Calculate({ gates, cnotGates, czGates, swapGates,
 
     const sendCalculate = () => {
         request_backend(
-            quantum_encode(extractCircuitData(gates, cnotGates, czGates, swapGates, measureNthQ, numQubits), "0")
+            quantum_encode(extractCircuitData(gates, cnotGates, czGates, swapGates, measureNthQ, numQubits, controlledGates), "0")
         ).then(responseText => { setLog(responseText); ParseResultData({ data: responseText, setProbData, setEdgesResultGraph, setVerticesResultGraph, setMeasuredValue, setMeasurementHist }) });
 
 
@@ -108,13 +136,21 @@ export function SendToBackEnd_Calculate({ gates, cnotGates, czGates, swapGates,
 
     const sendProbability = () => {
         request_backend(
-            quantum_encode(extractCircuitData(gates, cnotGates, czGates, swapGates, measureNthQ, numQubits), "1")
+            quantum_encode(extractCircuitData(gates, cnotGates, czGates, swapGates, measureNthQ, numQubits, controlledGates), "1")
         ).then(responseText => { setLog(responseText); ParseResultData({ data: responseText, setProbData, setEdgesResultGraph, setVerticesResultGraph, setMeasuredValue, setMeasurementHist }) });
     };
 
     const sendMeasure = () => {
         request_backend(
-            quantum_encode(extractCircuitData(gates, cnotGates, czGates, swapGates, measureNthQ, numQubits), "2")
+            quantum_encode(extractCircuitData(gates, cnotGates, czGates, swapGates, measureNthQ, numQubits, controlledGates), "2")
+        ).then(responseText => { setLog(responseText); ParseResultData({ data: responseText, setProbData, setEdgesResultGraph, setVerticesResultGraph, setMeasuredValue, setMeasurementHist }) });
+    };
+
+    // the final state is sampled `shots` times by the simulator, the histogram arrives in a single reply
+    const shots = 1024;
+    const sendSample = () => {
+        request_backend(
+            quantum_encode(extractCircuitData(gates, cnotGates, czGates, swapGates, measureNthQ, numQubits, controlledGates), "0"), "&snapshots=final&shots=" + shots
         ).then(responseText => { setLog(responseText); ParseResultData({ data: responseText, setProbData, setEdgesResultGraph, setVerticesResultGraph, setMeasuredValue, setMeasurementHist }) });
     };
 
@@ -156,6 +192,16 @@ export function SendToBackEnd_Calculate({ gates, cnotGates, czGates, swapGates,
             >
                 Measure
             </Button>
+            <Button
+                variant="outline"
+                style={{
+                    width: "100%",
+                    padding: "10px",
+                }}
+                onClick={sendSample}
+            >
+                Sample {shots} Shots
+            </Button>
             <Button
                 variant="outline"
                 style={{